@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+namespace memory {
+
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Allocator for std::vector whose buffer starts on an Alignment boundary.
+template <typename T, size_t Alignment = CACHE_LINE_SIZE>
+class AlignedAllocator {
+   public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+    T* allocate(size_t count) {
+        return static_cast<T*>(
+            ::operator new(count * sizeof(T), std::align_val_t{Alignment}));
+    }
+
+    void deallocate(T* pointer, size_t) {
+        ::operator delete(pointer, std::align_val_t{Alignment});
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment>&) const {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, Alignment>&) const {
+        return false;
+    }
+};
+
+}  // namespace memory
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+namespace graph {
+
+// Strongly and weakly connected components of a graph as it was when they
+// were computed. Strong components are numbered the way Tarjan's algorithm
+// closes them, in reverse topological order of the condensation: an edge
+// never leads to a component with a larger number. So a route from one
+// vertex to another can only exist when both lie in one weak component
+// and the origin's strong component number is not the smaller one, which
+// rejects most unreachable pairs in O(1).
+class GraphComponents {
+   public:
+    GraphComponents() = default;
+
+    template <typename Weight>
+    explicit GraphComponents(const DirectedWeightedGraph<Weight>& graph);
+
+    // False only when there is no route from `from` to `to`.
+    bool MayReach(VertexId from, VertexId to) const {
+        return weak_components_[from] == weak_components_[to] &&
+               strong_components_[from] >= strong_components_[to];
+    }
+
+    // Weak components are numbered in order of their smallest vertex.
+    uint32_t GetWeakComponent(VertexId vertex) const {
+        return weak_components_[vertex];
+    }
+    uint32_t GetStrongComponent(VertexId vertex) const {
+        return strong_components_[vertex];
+    }
+    size_t GetWeakComponentCount() const { return weak_component_count_; }
+    size_t GetStrongComponentCount() const { return strong_component_count_; }
+
+   private:
+    template <typename Weight>
+    void FindWeakComponents(const DirectedWeightedGraph<Weight>& graph);
+    template <typename Weight>
+    void FindStrongComponents(const DirectedWeightedGraph<Weight>& graph);
+
+    std::vector<uint32_t> weak_components_;
+    std::vector<uint32_t> strong_components_;
+    size_t weak_component_count_ = 0;
+    size_t strong_component_count_ = 0;
+};
+
+template <typename Weight>
+GraphComponents::GraphComponents(const DirectedWeightedGraph<Weight>& graph) {
+    FindWeakComponents(graph);
+    FindStrongComponents(graph);
+}
+
+// Union-find over the edges with path halving.
+template <typename Weight>
+void GraphComponents::FindWeakComponents(
+    const DirectedWeightedGraph<Weight>& graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+    std::vector<VertexId> parents(vertex_count);
+    std::iota(parents.begin(), parents.end(), 0);
+    const auto find_root = [&parents](VertexId vertex) {
+        while (parents[vertex] != vertex) {
+            parents[vertex] = parents[parents[vertex]];
+            vertex = parents[vertex];
+        }
+        return vertex;
+    };
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        const Edge<Weight>& edge = graph.GetEdge(edge_id);
+        const VertexId from_root = find_root(edge.from);
+        const VertexId to_root = find_root(edge.to);
+        if (from_root != to_root) {
+            parents[std::max(from_root, to_root)] =
+                std::min(from_root, to_root);
+        }
+    }
+
+    // Every root is its component's smallest vertex, so it is met first.
+    weak_components_.resize(vertex_count);
+    weak_component_count_ = 0;
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        const VertexId root = find_root(vertex);
+        weak_components_[vertex] = root == vertex
+                                       ? weak_component_count_++
+                                       : weak_components_[root];
+    }
+}
+
+// Tarjan's algorithm with an explicit stack of (vertex, next edge) frames.
+template <typename Weight>
+void GraphComponents::FindStrongComponents(
+    const DirectedWeightedGraph<Weight>& graph) {
+    constexpr uint32_t UNVISITED = std::numeric_limits<uint32_t>::max();
+    const size_t vertex_count = graph.GetVertexCount();
+    std::vector<uint32_t> indices(vertex_count, UNVISITED);
+    std::vector<uint32_t> low_links(vertex_count);
+    std::vector<bool> is_on_stack(vertex_count, false);
+    std::vector<VertexId> component_stack;
+    std::vector<std::pair<VertexId, size_t>> call_stack;
+    uint32_t next_index = 0;
+
+    strong_components_.resize(vertex_count);
+    strong_component_count_ = 0;
+    const auto visit = [&](VertexId vertex) {
+        indices[vertex] = low_links[vertex] = next_index++;
+        component_stack.push_back(vertex);
+        is_on_stack[vertex] = true;
+        call_stack.emplace_back(vertex, 0);
+    };
+    for (VertexId root = 0; root < vertex_count; ++root) {
+        if (indices[root] != UNVISITED) {
+            continue;
+        }
+        visit(root);
+        while (!call_stack.empty()) {
+            const VertexId vertex = call_stack.back().first;
+            const auto edges = graph.GetIncidentEdges(vertex);
+            const size_t edge_index = call_stack.back().second++;
+            if (edges.begin() + edge_index != edges.end()) {
+                const VertexId to =
+                    graph.GetEdge(*(edges.begin() + edge_index)).to;
+                if (indices[to] == UNVISITED) {
+                    visit(to);
+                } else if (is_on_stack[to]) {
+                    low_links[vertex] =
+                        std::min(low_links[vertex], indices[to]);
+                }
+                continue;
+            }
+
+            if (low_links[vertex] == indices[vertex]) {
+                VertexId member;
+                do {
+                    member = component_stack.back();
+                    component_stack.pop_back();
+                    is_on_stack[member] = false;
+                    strong_components_[member] = strong_component_count_;
+                } while (member != vertex);
+                ++strong_component_count_;
+            }
+            call_stack.pop_back();
+            if (!call_stack.empty()) {
+                const VertexId parent = call_stack.back().first;
+                low_links[parent] =
+                    std::min(low_links[parent], low_links[vertex]);
+            }
+        }
+    }
+}
+
+}  // namespace graph
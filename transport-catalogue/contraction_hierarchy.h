@@ -0,0 +1,456 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+#include "search_state.h"
+
+namespace graph {
+
+// Contraction hierarchies: vertices are contracted one by one in order of
+// importance, and shortcut edges preserve shortest paths among the vertices
+// that remain. A query then runs two small Dijkstra searches that only go
+// up the hierarchy and meet at the most important vertex of the route.
+template <typename Weight>
+class ContractionHierarchyRouter : public RouterEngine<Weight> {
+   private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+   public:
+    using typename RouterEngine<Weight>::RouteInfo;
+
+    explicit ContractionHierarchyRouter(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from,
+                                        VertexId to) const override;
+
+    size_t GetShortcutCount() const {
+        return edges_.size() - graph_.GetEdgeCount();
+    }
+
+   private:
+    // Original edges keep their graph EdgeId in first_part. Shortcuts refer
+    // to the two hierarchy edges they replace.
+    struct HierarchyEdge {
+        VertexId from;
+        VertexId to;
+        Weight weight;
+        EdgeId first_part;
+        EdgeId second_part;
+
+        bool IsShortcut() const {
+            return second_part != NO_EDGE;
+        }
+    };
+
+    // Edges going up the hierarchy, grouped by the vertex they are scanned
+    // from: the source for the forward search and the target for the
+    // backward one.
+    struct UpwardEdges {
+        std::vector<size_t> offsets;
+        std::vector<EdgeId> edges;
+    };
+
+    struct QueryState {
+        SearchState<Weight> forward;
+        SearchState<Weight> backward;
+    };
+
+    class Contractor;
+
+    static QueryState& GetQueryState() {
+        static thread_local QueryState state;
+        return state;
+    }
+
+    template <typename NextVertex>
+    void BuildUpwardEdges(UpwardEdges& upward, NextVertex next_vertex) const;
+
+    void ScanUpward(SearchState<Weight>& state, const UpwardEdges& upward,
+                    bool is_forward, const SearchState<Weight>& opposite,
+                    std::optional<Weight>& best_weight,
+                    VertexId& meeting_vertex) const;
+
+    void UnpackEdge(EdgeId edge_id, std::vector<EdgeId>& result) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    const Graph& graph_;
+    std::vector<HierarchyEdge> edges_;
+    std::vector<size_t> ranks_;
+    UpwardEdges forward_edges_;
+    UpwardEdges backward_edges_;
+};
+
+// Owns the adjacency of the vertices that are not contracted yet while the
+// hierarchy is being built.
+template <typename Weight>
+class ContractionHierarchyRouter<Weight>::Contractor {
+   public:
+    explicit Contractor(ContractionHierarchyRouter& router)
+        : router_(router),
+          vertex_count_(router.graph_.GetVertexCount()),
+          out_edges_(vertex_count_),
+          in_edges_(vertex_count_),
+          contracted_neighbours_(vertex_count_, 0) {
+        for (EdgeId edge_id = 0; edge_id < router_.edges_.size(); ++edge_id) {
+            const auto& edge = router_.edges_[edge_id];
+            if (edge.from != edge.to) {
+                out_edges_[edge.from].push_back(edge_id);
+                in_edges_[edge.to].push_back(edge_id);
+            }
+        }
+    }
+
+    void Run() {
+        using Candidate = std::pair<int, VertexId>;
+        std::priority_queue<Candidate, std::vector<Candidate>,
+                            std::greater<Candidate>>
+            queue;
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            queue.push({GetPriority(vertex), vertex});
+        }
+
+        size_t rank = 0;
+        while (!queue.empty()) {
+            const VertexId vertex = queue.top().second;
+            queue.pop();
+            // Priorities go stale as neighbours get contracted, so they are
+            // refreshed lazily when a vertex reaches the top.
+            const int priority = GetPriority(vertex);
+            if (!queue.empty() && priority > queue.top().first) {
+                queue.push({priority, vertex});
+                continue;
+            }
+            Contract(vertex, true);
+            router_.ranks_[vertex] = rank++;
+        }
+    }
+
+   private:
+    struct Shortcut {
+        EdgeId in_edge;
+        EdgeId out_edge;
+        Weight weight;
+    };
+
+    int GetPriority(VertexId vertex) {
+        const size_t shortcut_count = Contract(vertex, false);
+        const size_t degree =
+            in_edges_[vertex].size() + out_edges_[vertex].size();
+        return static_cast<int>(shortcut_count) - static_cast<int>(degree) +
+               contracted_neighbours_[vertex];
+    }
+
+    // Returns how many shortcuts contracting the vertex needs and, when
+    // is_applied is set, adds them and removes the vertex from the graph.
+    size_t Contract(VertexId vertex, bool is_applied) {
+        std::vector<Shortcut> shortcuts;
+        for (const EdgeId in_edge : in_edges_[vertex]) {
+            const VertexId source = router_.edges_[in_edge].from;
+            Weight max_weight = ZERO_WEIGHT;
+            targets_.clear();
+            for (const EdgeId out_edge : out_edges_[vertex]) {
+                const auto& edge = router_.edges_[out_edge];
+                if (edge.to != source) {
+                    max_weight = std::max(
+                        max_weight, router_.edges_[in_edge].weight + edge.weight);
+                    targets_.push_back(edge.to);
+                }
+            }
+            if (targets_.empty()) {
+                continue;
+            }
+
+            FindWitnesses(source, vertex, max_weight,
+                          is_applied ? CONTRACTION_SETTLE_LIMIT
+                                     : SIMULATION_SETTLE_LIMIT);
+            for (const EdgeId out_edge : out_edges_[vertex]) {
+                const auto& edge = router_.edges_[out_edge];
+                if (edge.to == source) {
+                    continue;
+                }
+                const Weight weight =
+                    router_.edges_[in_edge].weight + edge.weight;
+                if (!witness_search_.IsReached(edge.to) ||
+                    witness_search_.weights[edge.to] > weight) {
+                    shortcuts.push_back({in_edge, out_edge, weight});
+                }
+            }
+        }
+
+        if (is_applied) {
+            for (const Shortcut& shortcut : shortcuts) {
+                AddShortcut(shortcut);
+            }
+            for (const EdgeId edge_id : in_edges_[vertex]) {
+                const VertexId neighbour = router_.edges_[edge_id].from;
+                ++contracted_neighbours_[neighbour];
+                Erase(out_edges_[neighbour], edge_id);
+            }
+            for (const EdgeId edge_id : out_edges_[vertex]) {
+                const VertexId neighbour = router_.edges_[edge_id].to;
+                ++contracted_neighbours_[neighbour];
+                Erase(in_edges_[neighbour], edge_id);
+            }
+            std::vector<EdgeId>().swap(in_edges_[vertex]);
+            std::vector<EdgeId>().swap(out_edges_[vertex]);
+        }
+        return shortcuts.size();
+    }
+
+    static void Erase(std::vector<EdgeId>& edge_ids, EdgeId edge_id) {
+        const auto it = std::find(edge_ids.begin(), edge_ids.end(), edge_id);
+        if (it != edge_ids.end()) {
+            *it = edge_ids.back();
+            edge_ids.pop_back();
+        }
+    }
+
+    // Bounded Dijkstra from the source that avoids the vertex being
+    // contracted and stops once every target is settled. A target it
+    // reaches cheaply enough needs no shortcut; a target it gives up on
+    // merely gets a redundant one.
+    void FindWitnesses(VertexId source, VertexId excluded, Weight max_weight,
+                       size_t settle_limit) {
+        witness_search_.Prepare(vertex_count_);
+        if (target_stamps_.size() < vertex_count_) {
+            target_stamps_.resize(vertex_count_, 0);
+        }
+        size_t remaining_targets = 0;
+        for (const VertexId target : targets_) {
+            if (target_stamps_[target] != witness_search_.stamp) {
+                target_stamps_[target] = witness_search_.stamp;
+                ++remaining_targets;
+            }
+        }
+
+        witness_search_.Reach(source, ZERO_WEIGHT, NO_EDGE);
+        witness_search_.Push(ZERO_WEIGHT, ZERO_WEIGHT, source);
+        while (!witness_search_.queue.empty()) {
+            const auto item = witness_search_.Pop();
+            if (witness_search_.IsStale(item)) {
+                continue;
+            }
+            if (item.weight > max_weight ||
+                ++witness_search_.settled_count > settle_limit) {
+                break;
+            }
+            if (target_stamps_[item.vertex] == witness_search_.stamp &&
+                --remaining_targets == 0) {
+                break;
+            }
+            for (const EdgeId edge_id : out_edges_[item.vertex]) {
+                const auto& edge = router_.edges_[edge_id];
+                if (edge.to == excluded) {
+                    continue;
+                }
+                const Weight weight = item.weight + edge.weight;
+                if (!witness_search_.IsReached(edge.to) ||
+                    weight < witness_search_.weights[edge.to]) {
+                    witness_search_.Reach(edge.to, weight, edge_id);
+                    witness_search_.Push(weight, weight, edge.to);
+                }
+            }
+        }
+    }
+
+    void AddShortcut(const Shortcut& shortcut) {
+        const VertexId from = router_.edges_[shortcut.in_edge].from;
+        const VertexId to = router_.edges_[shortcut.out_edge].to;
+        for (const EdgeId edge_id : out_edges_[from]) {
+            const auto& edge = router_.edges_[edge_id];
+            if (edge.to == to && !(shortcut.weight < edge.weight)) {
+                return;
+            }
+        }
+        const EdgeId edge_id = router_.edges_.size();
+        router_.edges_.push_back(
+            {from, to, shortcut.weight, shortcut.in_edge, shortcut.out_edge});
+        out_edges_[from].push_back(edge_id);
+        in_edges_[to].push_back(edge_id);
+    }
+
+    // Estimating priorities only needs a rough shortcut count, so those
+    // witness searches give up sooner than the ones that add shortcuts.
+    static constexpr size_t SIMULATION_SETTLE_LIMIT = 16;
+    static constexpr size_t CONTRACTION_SETTLE_LIMIT = 128;
+    ContractionHierarchyRouter& router_;
+    const size_t vertex_count_;
+    std::vector<std::vector<EdgeId>> out_edges_;
+    std::vector<std::vector<EdgeId>> in_edges_;
+    std::vector<int> contracted_neighbours_;
+    SearchState<Weight> witness_search_;
+    std::vector<VertexId> targets_;
+    std::vector<uint32_t> target_stamps_;
+};
+
+template <typename Weight>
+ContractionHierarchyRouter<Weight>::ContractionHierarchyRouter(
+    const Graph& graph)
+    : graph_(graph), ranks_(graph.GetVertexCount()) {
+    edges_.reserve(graph.GetEdgeCount());
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        const auto& edge = graph.GetEdge(edge_id);
+        if (edge.weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        edges_.push_back({edge.from, edge.to, edge.weight, edge_id, NO_EDGE});
+    }
+
+    Contractor(*this).Run();
+
+    BuildUpwardEdges(forward_edges_,
+                     [](const HierarchyEdge& edge) { return edge.to; });
+    BuildUpwardEdges(backward_edges_,
+                     [](const HierarchyEdge& edge) { return edge.from; });
+}
+
+template <typename Weight>
+template <typename NextVertex>
+void ContractionHierarchyRouter<Weight>::BuildUpwardEdges(
+    UpwardEdges& upward, NextVertex next_vertex) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    std::vector<EdgeId> upward_edges;
+    for (EdgeId edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+        const auto& edge = edges_[edge_id];
+        const VertexId next = next_vertex(edge);
+        const VertexId current = next == edge.to ? edge.from : edge.to;
+        if (ranks_[next] > ranks_[current]) {
+            upward_edges.push_back(edge_id);
+        }
+    }
+
+    const auto get_current = [&](EdgeId edge_id) {
+        const auto& edge = edges_[edge_id];
+        return next_vertex(edge) == edge.to ? edge.from : edge.to;
+    };
+    std::stable_sort(upward_edges.begin(), upward_edges.end(),
+                     [&](EdgeId lhs, EdgeId rhs) {
+                         return get_current(lhs) < get_current(rhs);
+                     });
+
+    upward.offsets.assign(vertex_count + 1, 0);
+    for (const EdgeId edge_id : upward_edges) {
+        ++upward.offsets[get_current(edge_id) + 1];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        upward.offsets[vertex + 1] += upward.offsets[vertex];
+    }
+    upward.edges = std::move(upward_edges);
+}
+
+template <typename Weight>
+void ContractionHierarchyRouter<Weight>::ScanUpward(
+    SearchState<Weight>& state, const UpwardEdges& upward, bool is_forward,
+    const SearchState<Weight>& opposite, std::optional<Weight>& best_weight,
+    VertexId& meeting_vertex) const {
+    const auto item = state.Pop();
+    if (state.IsStale(item)) {
+        return;
+    }
+    ++state.settled_count;
+    if (opposite.IsReached(item.vertex)) {
+        const Weight weight = item.weight + opposite.weights[item.vertex];
+        if (!best_weight || weight < *best_weight) {
+            best_weight = weight;
+            meeting_vertex = item.vertex;
+        }
+    }
+    for (size_t i = upward.offsets[item.vertex];
+         i < upward.offsets[item.vertex + 1]; ++i) {
+        const EdgeId edge_id = upward.edges[i];
+        const auto& edge = edges_[edge_id];
+        const VertexId next = is_forward ? edge.to : edge.from;
+        const Weight weight = item.weight + edge.weight;
+        if (!state.IsReached(next) || weight < state.weights[next]) {
+            state.Reach(next, weight, edge_id);
+            state.Push(weight, weight, next);
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename ContractionHierarchyRouter<Weight>::RouteInfo>
+ContractionHierarchyRouter<Weight>::BuildRoute(VertexId from,
+                                               VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+
+    QueryState& state = GetQueryState();
+    state.forward.Prepare(vertex_count);
+    state.backward.Prepare(vertex_count);
+    state.forward.Reach(from, ZERO_WEIGHT, NO_EDGE);
+    state.forward.Push(ZERO_WEIGHT, ZERO_WEIGHT, from);
+    state.backward.Reach(to, ZERO_WEIGHT, NO_EDGE);
+    state.backward.Push(ZERO_WEIGHT, ZERO_WEIGHT, to);
+
+    std::optional<Weight> best_weight;
+    VertexId meeting_vertex = from;
+    const auto is_done = [&best_weight](const SearchState<Weight>& search) {
+        return search.queue.empty() ||
+               (best_weight && !(search.queue.front().key < *best_weight));
+    };
+    while (!is_done(state.forward) || !is_done(state.backward)) {
+        const bool is_forward =
+            is_done(state.backward) ||
+            (!is_done(state.forward) && !(state.backward.queue.front().key <
+                                          state.forward.queue.front().key));
+        if (is_forward) {
+            ScanUpward(state.forward, forward_edges_, true, state.backward,
+                       best_weight, meeting_vertex);
+        } else {
+            ScanUpward(state.backward, backward_edges_, false, state.forward,
+                       best_weight, meeting_vertex);
+        }
+    }
+    if (!best_weight) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> hierarchy_edges;
+    for (EdgeId edge_id = state.forward.prev_edges[meeting_vertex];
+         edge_id != NO_EDGE;
+         edge_id = state.forward.prev_edges[edges_[edge_id].from]) {
+        hierarchy_edges.push_back(edge_id);
+    }
+    std::reverse(hierarchy_edges.begin(), hierarchy_edges.end());
+    for (EdgeId edge_id = state.backward.prev_edges[meeting_vertex];
+         edge_id != NO_EDGE;
+         edge_id = state.backward.prev_edges[edges_[edge_id].to]) {
+        hierarchy_edges.push_back(edge_id);
+    }
+
+    std::vector<EdgeId> edges;
+    for (const EdgeId edge_id : hierarchy_edges) {
+        UnpackEdge(edge_id, edges);
+    }
+
+    return RouteInfo{*best_weight, std::move(edges)};
+}
+
+template <typename Weight>
+void ContractionHierarchyRouter<Weight>::UnpackEdge(
+    EdgeId edge_id, std::vector<EdgeId>& result) const {
+    std::vector<EdgeId> stack{edge_id};
+    while (!stack.empty()) {
+        const auto& edge = edges_[stack.back()];
+        stack.pop_back();
+        if (edge.IsShortcut()) {
+            stack.push_back(edge.second_part);
+            stack.push_back(edge.first_part);
+        } else {
+            result.push_back(edge.first_part);
+        }
+    }
+}
+
+}  // namespace graph
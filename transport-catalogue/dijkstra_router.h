@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+#include "search_state.h"
+
+namespace graph {
+
+// Answers every query with its own Dijkstra search instead of precomputing
+// all pairs, so construction is O(E) and memory stays linear in the graph.
+// With a potential the search becomes A*: the potential must be a lower
+// bound on the remaining weight to the target that never drops by more
+// than an edge's weight along that edge.
+template <typename Weight>
+class DijkstraRouter : public RouterEngine<Weight> {
+   private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+   public:
+    using typename RouterEngine<Weight>::RouteInfo;
+    using Potential = std::function<Weight(VertexId vertex, VertexId target)>;
+
+    explicit DijkstraRouter(const Graph& graph, Potential potential = {});
+
+    std::optional<RouteInfo> BuildRoute(VertexId from,
+                                        VertexId to) const override;
+
+    // Nothing is precomputed, searches read the updated graph directly.
+    bool UpdateEdgeWeights(
+        const std::vector<EdgeWeightChange<Weight>>& changes) override {
+        for (const auto& change : changes) {
+            if (graph_.GetEdge(change.edge_id).weight < ZERO_WEIGHT) {
+                throw std::domain_error(
+                    "Edges' weights should be non-negative");
+            }
+        }
+        return true;
+    }
+
+   private:
+    struct QueryState {
+        SearchState<Weight> search;
+        std::vector<Weight> potentials;
+    };
+
+    // Scratch buffers are shared by all searches running on one thread.
+    static QueryState& GetQueryState() {
+        static thread_local QueryState state;
+        return state;
+    }
+
+    static constexpr Weight ZERO_WEIGHT{};
+    const Graph& graph_;
+    Potential potential_;
+};
+
+template <typename Weight>
+DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph, Potential potential)
+    : graph_(graph), potential_(std::move(potential)) {
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+        if (graph.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+}
+
+template <typename Weight>
+std::optional<typename DijkstraRouter<Weight>::RouteInfo>
+DijkstraRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+
+    QueryState& query_state = GetQueryState();
+    SearchState<Weight>& state = query_state.search;
+    std::vector<Weight>& potentials = query_state.potentials;
+    state.Prepare(vertex_count);
+    if (potential_ && potentials.size() < vertex_count) {
+        potentials.resize(vertex_count);
+    }
+
+    const auto reach = [&](VertexId vertex, Weight weight, EdgeId prev_edge) {
+        Weight key = weight;
+        if (potential_) {
+            if (!state.IsReached(vertex)) {
+                potentials[vertex] = potential_(vertex, to);
+            }
+            key += potentials[vertex];
+        }
+        state.Reach(vertex, weight, prev_edge);
+        state.Push(key, weight, vertex);
+    };
+
+    reach(from, ZERO_WEIGHT, NO_EDGE);
+    bool is_found = false;
+    while (!state.queue.empty()) {
+        const auto item = state.Pop();
+        if (state.IsStale(item)) {
+            continue;
+        }
+        ++state.settled_count;
+        if (item.vertex == to) {
+            is_found = true;
+            break;
+        }
+        graph_.ForEachOutgoingArc(item.vertex, [&](const Arc<Weight>& arc) {
+            const Weight candidate_weight = item.weight + arc.weight;
+            if (!state.IsReached(arc.to) ||
+                candidate_weight < state.weights[arc.to]) {
+                reach(arc.to, candidate_weight, arc.edge_id);
+            }
+        });
+    }
+    if (!is_found) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = state.prev_edges[to]; edge_id != NO_EDGE;
+         edge_id = state.prev_edges[graph_.GetEdge(edge_id).from]) {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+
+    return RouteInfo{state.weights[to], std::move(edges),
+                     state.settled_count};
+}
+
+// Bounded one-to-all search: calls visit(vertex, weight) for every vertex
+// within max_weight of from, in order of weight, and stops as soon as the
+// closest unsettled vertex is farther than that or visit returns false.
+// The returned state holds the search tree until the next search on the
+// calling thread.
+template <typename Weight, typename Visitor>
+const SearchState<Weight>& VisitVerticesWithin(
+    const DirectedWeightedGraph<Weight>& graph, VertexId from,
+    Weight max_weight, Visitor visit) {
+    static thread_local SearchState<Weight> state;
+    state.Prepare(graph.GetVertexCount());
+    state.Reach(from, Weight{}, NO_EDGE);
+    state.Push(Weight{}, Weight{}, from);
+    while (!state.queue.empty()) {
+        const auto item = state.Pop();
+        if (state.IsStale(item)) {
+            continue;
+        }
+        if (max_weight < item.weight) {
+            break;
+        }
+        ++state.settled_count;
+        if (!visit(item.vertex, item.weight)) {
+            break;
+        }
+        graph.ForEachOutgoingArc(item.vertex, [&](const Arc<Weight>& arc) {
+            const Weight candidate_weight = item.weight + arc.weight;
+            if (!state.IsReached(arc.to) ||
+                candidate_weight < state.weights[arc.to]) {
+                state.Reach(arc.to, candidate_weight, arc.edge_id);
+                state.Push(candidate_weight, candidate_weight, arc.to);
+            }
+        });
+    }
+    return state;
+}
+
+// Routes from one vertex to many, read off a single shortest-path tree that
+// grows only until every target is settled. Each route reports the
+// vertices settled by the time its target was, as a search for that target
+// alone would.
+template <typename Weight>
+std::vector<std::optional<typename RouterEngine<Weight>::RouteInfo>>
+BuildRoutesFrom(const DirectedWeightedGraph<Weight>& graph, VertexId from,
+                const std::vector<VertexId>& targets) {
+    // Zero until the target is settled.
+    std::unordered_map<VertexId, size_t> target_settled_counts;
+    for (const VertexId target : targets) {
+        target_settled_counts.emplace(target, 0);
+    }
+    size_t unsettled_count = target_settled_counts.size();
+    size_t settled_count = 0;
+    const SearchState<Weight>& state = VisitVerticesWithin(
+        graph, from, std::numeric_limits<Weight>::max(),
+        [&](VertexId vertex, Weight) {
+            ++settled_count;
+            const auto target = target_settled_counts.find(vertex);
+            if (target != target_settled_counts.end()) {
+                target->second = settled_count;
+                --unsettled_count;
+            }
+            return unsettled_count > 0;
+        });
+
+    std::vector<std::optional<typename RouterEngine<Weight>::RouteInfo>>
+        routes(targets.size());
+    for (size_t i = 0; i < targets.size(); ++i) {
+        const VertexId target = targets[i];
+        const size_t target_settled_count = target_settled_counts.at(target);
+        if (target_settled_count == 0) {
+            continue;
+        }
+        std::vector<EdgeId> edges;
+        for (EdgeId edge_id = state.prev_edges[target]; edge_id != NO_EDGE;
+             edge_id = state.prev_edges[graph.GetEdge(edge_id).from]) {
+            edges.push_back(edge_id);
+        }
+        std::reverse(edges.begin(), edges.end());
+        routes[i] = {state.weights[target], std::move(edges),
+                     target_settled_count};
+    }
+    return routes;
+}
+
+}  // namespace graph
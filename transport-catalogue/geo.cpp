@@ -2,7 +2,10 @@
 #include "geo.h"
 
 #include <cmath>
+#include <cstdint>
 #include <cstdlib>
+#include <numeric>
+#include <utility>
 
 namespace geo {
 
@@ -27,4 +30,61 @@ double ComputeDistance(geo::Coordinates from, geo::Coordinates to) {
            EARTH_RADIUS;
 }
 
+namespace {
+constexpr uint32_t HILBERT_GRID_SIZE = 1u << 16;
+
+// Position of cell (x, y) along the curve filling the grid.
+uint64_t ComputeHilbertIndex(uint32_t x, uint32_t y) {
+    uint64_t index = 0;
+    for (uint32_t step = HILBERT_GRID_SIZE / 2; step > 0; step /= 2) {
+        const uint32_t rx = (x & step) ? 1 : 0;
+        const uint32_t ry = (y & step) ? 1 : 0;
+        index += static_cast<uint64_t>(step) * step * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = HILBERT_GRID_SIZE - 1 - x;
+                y = HILBERT_GRID_SIZE - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+uint32_t ToGridCell(double value, double min, double max) {
+    if (IsZero(max - min)) {
+        return 0;
+    }
+    const double cell = (value - min) / (max - min) * (HILBERT_GRID_SIZE - 1);
+    return static_cast<uint32_t>(std::lround(cell));
+}
+}  // namespace
+
+std::vector<size_t> ComputeHilbertOrder(
+    const std::vector<Coordinates> &points) {
+    std::vector<size_t> order(points.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (points.empty()) {
+        return order;
+    }
+    const auto [left_it, right_it] = std::minmax_element(
+        points.begin(), points.end(),
+        [](const auto &lhs, const auto &rhs) { return lhs.lng < rhs.lng; });
+    const auto [bottom_it, top_it] = std::minmax_element(
+        points.begin(), points.end(),
+        [](const auto &lhs, const auto &rhs) { return lhs.lat < rhs.lat; });
+
+    std::vector<uint64_t> indices(points.size());
+    for (size_t i = 0; i < points.size(); ++i) {
+        indices[i] = ComputeHilbertIndex(
+            ToGridCell(points[i].lng, left_it->lng, right_it->lng),
+            ToGridCell(points[i].lat, bottom_it->lat, top_it->lat));
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&indices](size_t lhs, size_t rhs) {
+                         return indices[lhs] < indices[rhs];
+                     });
+    return order;
+}
+
 }  // namespace geo
\ No newline at end of file
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cstddef>
 #include <optional>
+#include <vector>
 
 #include "svg.h"
 
@@ -76,4 +78,9 @@ class SphereProjector {
 
 double ComputeDistance(geo::Coordinates from, geo::Coordinates to);
 
+// Indices of the points in the order a Hilbert curve over their bounding
+// box visits them, so points near each other in the order are near each
+// other on the map. Points in the same curve cell keep their input order.
+std::vector<size_t> ComputeHilbertOrder(const std::vector<Coordinates> &points);
+
 }  // namespace geo
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdlib>
+#include <stdexcept>
 #include <vector>
 
 #include "ranges.h"
@@ -17,43 +18,153 @@ struct Edge {
     Weight weight;
 };
 
+// Outgoing edge as stored in a frozen graph: everything a search needs to
+// relax it, without a lookup into the edge list.
 template <typename Weight>
-class DirectedWeightedGraph {
+struct Arc {
+    VertexId to;
+    Weight weight;
+    EdgeId edge_id;
+};
+
+// Payload of a graph whose edges carry nothing but their weight.
+struct NoPayload {};
+
+template <typename Weight, typename Payload = NoPayload>
+class DirectedWeightedGraph;
+
+// Edges are added during a build phase. Freeze() then packs the adjacency
+// into compressed sparse rows: one offsets array and one arc array sorted
+// by source, so scanning a vertex's edges is a sequential read. A frozen
+// graph accepts no new vertices or edges until Unfreeze(); edge weights may
+// change either way.
+template <typename Weight>
+class DirectedWeightedGraph<Weight, NoPayload> {
    private:
     using IncidenceList = std::vector<EdgeId>;
     using IncidentEdgesRange =
         ranges::Range<typename IncidenceList::const_iterator>;
+    using ArcsRange =
+        ranges::Range<typename std::vector<Arc<Weight>>::const_iterator>;
 
    public:
     DirectedWeightedGraph() = default;
     explicit DirectedWeightedGraph(size_t vertex_count);
+    void AddVertices(size_t count);
     EdgeId AddEdge(const Edge<Weight>& edge);
+    void SetEdgeWeight(EdgeId edge_id, Weight weight);
+    void Freeze();
+    void Unfreeze();
 
+    bool IsFrozen() const;
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
     const Edge<Weight>& GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
+    // Only available once the graph is frozen.
+    ArcsRange GetOutgoingArcs(VertexId vertex) const;
+
+    // Calls callback(const Arc<Weight>&) for every edge leaving the vertex,
+    // reading packed arcs when the graph is frozen.
+    template <typename Callback>
+    void ForEachOutgoingArc(VertexId vertex, Callback callback) const;
 
    private:
+    size_t vertex_count_ = 0;
     std::vector<Edge<Weight>> edges_;
     std::vector<IncidenceList> incidence_lists_;
+
+    bool is_frozen_ = false;
+    std::vector<size_t> arc_offsets_;
+    std::vector<Arc<Weight>> arcs_;
+    std::vector<EdgeId> arc_edge_ids_;
 };
 
 template <typename Weight>
 DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count)
-    : incidence_lists_(vertex_count) {}
+    : vertex_count_(vertex_count), incidence_lists_(vertex_count) {}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::AddVertices(size_t count) {
+    if (is_frozen_) {
+        throw std::logic_error("Cannot add a vertex to a frozen graph");
+    }
+    vertex_count_ += count;
+    incidence_lists_.resize(vertex_count_);
+}
 
 template <typename Weight>
 EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    if (is_frozen_) {
+        throw std::logic_error("Cannot add an edge to a frozen graph");
+    }
     edges_.push_back(edge);
     const EdgeId id = edges_.size() - 1;
     incidence_lists_.at(edge.from).push_back(id);
     return id;
 }
 
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Freeze() {
+    if (is_frozen_) {
+        return;
+    }
+    arc_offsets_.assign(vertex_count_ + 1, 0);
+    arcs_.reserve(edges_.size());
+    arc_edge_ids_.reserve(edges_.size());
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        for (const EdgeId edge_id : incidence_lists_[vertex]) {
+            const auto& edge = edges_[edge_id];
+            arcs_.push_back({edge.to, edge.weight, edge_id});
+            arc_edge_ids_.push_back(edge_id);
+        }
+        arc_offsets_[vertex + 1] = arcs_.size();
+    }
+    std::vector<IncidenceList>().swap(incidence_lists_);
+    is_frozen_ = true;
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::SetEdgeWeight(EdgeId edge_id,
+                                                  Weight weight) {
+    Edge<Weight>& edge = edges_.at(edge_id);
+    edge.weight = weight;
+    if (is_frozen_) {
+        for (size_t i = arc_offsets_[edge.from];
+             i < arc_offsets_[edge.from + 1]; ++i) {
+            if (arcs_[i].edge_id == edge_id) {
+                arcs_[i].weight = weight;
+                break;
+            }
+        }
+    }
+}
+
+template <typename Weight>
+void DirectedWeightedGraph<Weight>::Unfreeze() {
+    if (!is_frozen_) {
+        return;
+    }
+    incidence_lists_.assign(vertex_count_, {});
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        incidence_lists_[vertex].assign(
+            arc_edge_ids_.begin() + arc_offsets_[vertex],
+            arc_edge_ids_.begin() + arc_offsets_[vertex + 1]);
+    }
+    std::vector<size_t>().swap(arc_offsets_);
+    std::vector<Arc<Weight>>().swap(arcs_);
+    std::vector<EdgeId>().swap(arc_edge_ids_);
+    is_frozen_ = false;
+}
+
+template <typename Weight>
+bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return is_frozen_;
+}
+
 template <typename Weight>
 size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return vertex_count_;
 }
 
 template <typename Weight>
@@ -70,6 +181,63 @@ const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(
 template <typename Weight>
 typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
 DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
+    if (is_frozen_) {
+        return IncidentEdgesRange{
+            arc_edge_ids_.begin() + arc_offsets_.at(vertex),
+            arc_edge_ids_.begin() + arc_offsets_.at(vertex + 1)};
+    }
     return ranges::AsRange(incidence_lists_.at(vertex));
 }
+
+template <typename Weight>
+typename DirectedWeightedGraph<Weight>::ArcsRange
+DirectedWeightedGraph<Weight>::GetOutgoingArcs(VertexId vertex) const {
+    if (!is_frozen_) {
+        throw std::logic_error("Arcs are only available in a frozen graph");
+    }
+    return ArcsRange{arcs_.begin() + arc_offsets_.at(vertex),
+                     arcs_.begin() + arc_offsets_.at(vertex + 1)};
+}
+
+template <typename Weight>
+template <typename Callback>
+void DirectedWeightedGraph<Weight>::ForEachOutgoingArc(
+    VertexId vertex, Callback callback) const {
+    if (is_frozen_) {
+        for (size_t i = arc_offsets_[vertex]; i < arc_offsets_[vertex + 1];
+             ++i) {
+            callback(arcs_[i]);
+        }
+    } else {
+        for (const EdgeId edge_id : incidence_lists_.at(vertex)) {
+            const auto& edge = edges_[edge_id];
+            callback(Arc<Weight>{edge.to, edge.weight, edge_id});
+        }
+    }
+}
+
+// A graph that also keeps a Payload for every edge, in an array indexed by
+// EdgeId alongside the edges. Searches never read it: every router takes
+// the graph as a plain DirectedWeightedGraph<Weight>.
+template <typename Weight, typename Payload>
+class DirectedWeightedGraph : public DirectedWeightedGraph<Weight> {
+   private:
+    using Base = DirectedWeightedGraph<Weight>;
+
+   public:
+    using Base::Base;
+
+    EdgeId AddEdge(const Edge<Weight>& edge, const Payload& payload) {
+        const EdgeId id = Base::AddEdge(edge);
+        payloads_.push_back(payload);
+        return id;
+    }
+
+    const Payload& GetPayload(EdgeId edge_id) const {
+        return payloads_.at(edge_id);
+    }
+
+   private:
+    std::vector<Payload> payloads_;
+};
 }  // namespace graph
\ No newline at end of file
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+#include "search_state.h"
+
+namespace graph {
+
+struct HubLabelStats {
+    // Entries of all in and out labels.
+    size_t entry_count = 0;
+    size_t label_bytes = 0;
+    // Entries per label, counting a vertex's in and out labels apart.
+    double average_label_size = 0.0;
+};
+
+// Pruned landmark labeling. Every vertex gets an out label of (hub, weight
+// from the vertex to the hub) entries and an in label of (hub, weight from
+// the hub to the vertex) entries such that the best route between any two
+// vertices passes a hub found in both the origin's out label and the
+// target's in label. Hubs are taken from the highest degree down, and the
+// searches from a hub stop at vertices that the labels built so far
+// already answer as well, so later hubs add short labels. Labels are
+// sorted by hub rank and a query is a merge join of two of them. Each entry
+// also keeps the edge leaving its vertex towards the hub, or entering it
+// from the hub, so routes are unpacked hop by hop without a search.
+template <typename Weight>
+class HubLabelRouter : public RouterEngine<Weight> {
+   private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+   public:
+    using typename RouterEngine<Weight>::RouteInfo;
+
+    explicit HubLabelRouter(const Graph& graph);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from,
+                                        VertexId to) const override;
+    std::optional<Weight> GetRouteWeight(VertexId from,
+                                         VertexId to) const override;
+
+    HubLabelStats GetStats() const;
+
+   private:
+    using LabelEdgeId = uint32_t;
+
+    struct LabelEntry {
+        Weight weight;
+        uint32_t hub;
+        LabelEdgeId edge;
+    };
+
+    // Labels of vertex v are entries[offsets[v] .. offsets[v + 1]).
+    struct Labels {
+        std::vector<size_t> offsets;
+        std::vector<LabelEntry> entries;
+    };
+
+    struct HubWeight {
+        Weight weight;
+        uint32_t hub;
+    };
+
+    void BuildLabels();
+    static Labels PackLabels(std::vector<std::vector<LabelEntry>>& labels);
+
+    std::optional<HubWeight> FindBestHub(VertexId from, VertexId to) const;
+    const LabelEntry& FindEntry(const Labels& labels, VertexId vertex,
+                                uint32_t hub) const;
+    void CheckVertices(VertexId from, VertexId to) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    static constexpr LabelEdgeId NO_LABEL_EDGE =
+        std::numeric_limits<LabelEdgeId>::max();
+    const Graph& graph_;
+    // Vertices by rank.
+    std::vector<VertexId> hubs_;
+    Labels out_labels_;
+    Labels in_labels_;
+};
+
+template <typename Weight>
+HubLabelRouter<Weight>::HubLabelRouter(const Graph& graph) : graph_(graph) {
+    if (graph_.GetEdgeCount() >= NO_LABEL_EDGE) {
+        throw std::length_error("too many edges for hub labels");
+    }
+    for (EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+        if (graph_.GetEdge(edge_id).weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+    }
+    BuildLabels();
+}
+
+template <typename Weight>
+void HubLabelRouter<Weight>::BuildLabels() {
+    const size_t vertex_count = graph_.GetVertexCount();
+    const size_t edge_count = graph_.GetEdgeCount();
+
+    // Incoming arcs grouped by head; an arc's `to` is the edge's tail.
+    std::vector<size_t> in_offsets(vertex_count + 1, 0);
+    std::vector<Arc<Weight>> in_arcs(edge_count);
+    std::vector<size_t> degrees(vertex_count, 0);
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+        const Edge<Weight>& edge = graph_.GetEdge(edge_id);
+        ++in_offsets[edge.to + 1];
+        ++degrees[edge.from];
+        ++degrees[edge.to];
+    }
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        in_offsets[vertex + 1] += in_offsets[vertex];
+    }
+    std::vector<size_t> next_in_arc(in_offsets.begin(), in_offsets.end() - 1);
+    for (EdgeId edge_id = 0; edge_id < edge_count; ++edge_id) {
+        const Edge<Weight>& edge = graph_.GetEdge(edge_id);
+        in_arcs[next_in_arc[edge.to]++] = {edge.from, edge.weight, edge_id};
+    }
+
+    hubs_.resize(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        hubs_[vertex] = vertex;
+    }
+    std::stable_sort(hubs_.begin(), hubs_.end(),
+                     [&degrees](VertexId lhs, VertexId rhs) {
+                         return degrees[lhs] > degrees[rhs];
+                     });
+
+    std::vector<std::vector<LabelEntry>> out_labels(vertex_count);
+    std::vector<std::vector<LabelEntry>> in_labels(vertex_count);
+    // Weights between the current hub and the hubs in its own label,
+    // indexed by hub rank; every other slot holds no route.
+    std::vector<std::optional<Weight>> hub_weights(vertex_count);
+    SearchState<Weight> state;
+
+    // A forward search from the hub adds in labels, a backward one out
+    // labels. A vertex the labels already connect to the hub at no more
+    // than the search's weight is neither labelled nor expanded.
+    const auto run_pruned_search = [&](uint32_t rank, bool is_forward) {
+        const VertexId hub = hubs_[rank];
+        auto& hub_label = is_forward ? out_labels[hub] : in_labels[hub];
+        auto& labels = is_forward ? in_labels : out_labels;
+        for (const LabelEntry& entry : hub_label) {
+            hub_weights[entry.hub] = entry.weight;
+        }
+        const auto is_answered = [&](VertexId vertex, Weight weight) {
+            for (const LabelEntry& entry : labels[vertex]) {
+                const std::optional<Weight>& hub_weight =
+                    hub_weights[entry.hub];
+                if (hub_weight && *hub_weight + entry.weight <= weight) {
+                    return true;
+                }
+            }
+            return false;
+        };
+
+        state.Prepare(vertex_count);
+        state.Reach(hub, ZERO_WEIGHT, NO_EDGE);
+        state.Push(ZERO_WEIGHT, ZERO_WEIGHT, hub);
+        while (!state.queue.empty()) {
+            const auto item = state.Pop();
+            if (state.IsStale(item) || is_answered(item.vertex, item.weight)) {
+                continue;
+            }
+            const EdgeId prev_edge = state.prev_edges[item.vertex];
+            labels[item.vertex].push_back(
+                {item.weight, rank,
+                 prev_edge == NO_EDGE ? NO_LABEL_EDGE
+                                      : static_cast<LabelEdgeId>(prev_edge)});
+            const auto relax = [&](const Arc<Weight>& arc) {
+                const Weight candidate_weight = item.weight + arc.weight;
+                if (!state.IsReached(arc.to) ||
+                    candidate_weight < state.weights[arc.to]) {
+                    state.Reach(arc.to, candidate_weight, arc.edge_id);
+                    state.Push(candidate_weight, candidate_weight, arc.to);
+                }
+            };
+            if (is_forward) {
+                graph_.ForEachOutgoingArc(item.vertex, relax);
+            } else {
+                for (size_t i = in_offsets[item.vertex];
+                     i < in_offsets[item.vertex + 1]; ++i) {
+                    relax(in_arcs[i]);
+                }
+            }
+        }
+
+        for (const LabelEntry& entry : hub_label) {
+            hub_weights[entry.hub].reset();
+        }
+    };
+    for (uint32_t rank = 0; rank < vertex_count; ++rank) {
+        run_pruned_search(rank, true);
+        run_pruned_search(rank, false);
+    }
+
+    out_labels_ = PackLabels(out_labels);
+    in_labels_ = PackLabels(in_labels);
+}
+
+// Entries were appended in rank order, so every label is already sorted.
+template <typename Weight>
+typename HubLabelRouter<Weight>::Labels HubLabelRouter<Weight>::PackLabels(
+    std::vector<std::vector<LabelEntry>>& labels) {
+    Labels packed;
+    packed.offsets.reserve(labels.size() + 1);
+    packed.offsets.push_back(0);
+    for (const auto& label : labels) {
+        packed.offsets.push_back(packed.offsets.back() + label.size());
+    }
+    packed.entries.reserve(packed.offsets.back());
+    for (auto& label : labels) {
+        packed.entries.insert(packed.entries.end(), label.begin(),
+                              label.end());
+        std::vector<LabelEntry>().swap(label);
+    }
+    return packed;
+}
+
+template <typename Weight>
+std::optional<typename HubLabelRouter<Weight>::HubWeight>
+HubLabelRouter<Weight>::FindBestHub(VertexId from, VertexId to) const {
+    const LabelEntry* out = out_labels_.entries.data();
+    const LabelEntry* in = in_labels_.entries.data();
+    size_t i = out_labels_.offsets[from];
+    size_t j = in_labels_.offsets[to];
+    const size_t out_end = out_labels_.offsets[from + 1];
+    const size_t in_end = in_labels_.offsets[to + 1];
+    std::optional<HubWeight> best;
+    while (i < out_end && j < in_end) {
+        if (out[i].hub < in[j].hub) {
+            ++i;
+        } else if (in[j].hub < out[i].hub) {
+            ++j;
+        } else {
+            const Weight weight = out[i].weight + in[j].weight;
+            if (!best || weight < best->weight) {
+                best = HubWeight{weight, out[i].hub};
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return best;
+}
+
+template <typename Weight>
+const typename HubLabelRouter<Weight>::LabelEntry&
+HubLabelRouter<Weight>::FindEntry(const Labels& labels, VertexId vertex,
+                                  uint32_t hub) const {
+    return *std::lower_bound(
+        labels.entries.begin() + labels.offsets[vertex],
+        labels.entries.begin() + labels.offsets[vertex + 1], hub,
+        [](const LabelEntry& entry, uint32_t value) {
+            return entry.hub < value;
+        });
+}
+
+template <typename Weight>
+void HubLabelRouter<Weight>::CheckVertices(VertexId from, VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+}
+
+// The weight is summed along the unpacked edges from the origin on, as a
+// search would sum it, rather than taken from the two label entries.
+template <typename Weight>
+std::optional<typename HubLabelRouter<Weight>::RouteInfo>
+HubLabelRouter<Weight>::BuildRoute(VertexId from, VertexId to) const {
+    CheckVertices(from, to);
+    if (from == to) {
+        return RouteInfo{ZERO_WEIGHT, {}};
+    }
+    const std::optional<HubWeight> best_hub = FindBestHub(from, to);
+    if (!best_hub) {
+        return std::nullopt;
+    }
+    const VertexId hub = hubs_[best_hub->hub];
+
+    std::vector<EdgeId> edges;
+    for (VertexId vertex = from; vertex != hub;) {
+        const LabelEdgeId edge_id =
+            FindEntry(out_labels_, vertex, best_hub->hub).edge;
+        edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).to;
+    }
+    const size_t first_in_edge = edges.size();
+    for (VertexId vertex = to; vertex != hub;) {
+        const LabelEdgeId edge_id =
+            FindEntry(in_labels_, vertex, best_hub->hub).edge;
+        edges.push_back(edge_id);
+        vertex = graph_.GetEdge(edge_id).from;
+    }
+    std::reverse(edges.begin() + first_in_edge, edges.end());
+
+    Weight weight = ZERO_WEIGHT;
+    for (const EdgeId edge_id : edges) {
+        weight += graph_.GetEdge(edge_id).weight;
+    }
+    return RouteInfo{weight, std::move(edges)};
+}
+
+template <typename Weight>
+std::optional<Weight> HubLabelRouter<Weight>::GetRouteWeight(
+    VertexId from, VertexId to) const {
+    CheckVertices(from, to);
+    if (from == to) {
+        return ZERO_WEIGHT;
+    }
+    const std::optional<HubWeight> best_hub = FindBestHub(from, to);
+    if (!best_hub) {
+        return std::nullopt;
+    }
+    return best_hub->weight;
+}
+
+template <typename Weight>
+HubLabelStats HubLabelRouter<Weight>::GetStats() const {
+    HubLabelStats stats;
+    stats.entry_count =
+        out_labels_.entries.size() + in_labels_.entries.size();
+    stats.label_bytes =
+        stats.entry_count * sizeof(LabelEntry) +
+        (out_labels_.offsets.size() + in_labels_.offsets.size()) *
+            sizeof(size_t);
+    if (!hubs_.empty()) {
+        stats.average_label_size =
+            static_cast<double>(stats.entry_count) / (2 * hubs_.size());
+    }
+    return stats;
+}
+
+}  // namespace graph
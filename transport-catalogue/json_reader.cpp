@@ -1,14 +1,24 @@
 #include "json_reader.h"
 
+#include <algorithm>
 #include <cassert>
+#include <future>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <ostream>
 #include <sstream>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 #include "domain.h"
+#include "geo.h"
 #include "json.h"
+#include "json_builder.h"
 #include "request_handler.h"
 #include "transport_router.h"
 
@@ -46,23 +56,38 @@ RequestsInfo JsonReader::DivideRequests() {
 
 void JsonReader::ParseRequests(std::ostream& out) {
   ParseBaseRequests();
+  RequestHandler::RouterFuture router = StartRouterBuild();
   ParseRenderSettings();
-  json::Document stat_result = ParseStatRequests();
+  json::Document stat_result = ParseStatRequests(std::move(router));
   json::Print(stat_result, out);
 }
 
 void JsonReader::ParseBaseRequests() {
   // add all stops for correct bus handling
+  std::vector<const json::Dict*> stop_requests;
+  std::vector<geo::Coordinates> stop_coordinates;
   for (const auto& request : requests_.base_requests) {
-    auto request_as_map = request.AsMap();
-    std::string type = request_as_map.at("type"s).AsString();
-    if (type == "Stop"s) {
-      std::string id = request_as_map.at("name"s).AsString();
-      double latitude = request_as_map.at("latitude"s).AsDouble();
-      double longitude = request_as_map.at("longitude"s).AsDouble();
-      catalogue_->AddStop(id, {latitude, longitude});
+    const auto& request_as_map = request.AsMap();
+    if (request_as_map.at("type"s).AsString() == "Stop"s) {
+      stop_requests.push_back(&request_as_map);
+      stop_coordinates.push_back(
+          {request_as_map.at("latitude"s).AsDouble(),
+           request_as_map.at("longitude"s).AsDouble()});
     }
   }
+  // The catalogue then stores the stops in the order the router numbers
+  // them, so the stops of a neighbourhood share cache lines in both.
+  std::vector<size_t> stop_order(stop_requests.size());
+  if (!requests_.routing_settings.empty() &&
+      ParseRoutingSettings().vertex_order == router::VertexOrder::HILBERT) {
+    stop_order = geo::ComputeHilbertOrder(stop_coordinates);
+  } else {
+    std::iota(stop_order.begin(), stop_order.end(), 0);
+  }
+  for (const size_t index : stop_order) {
+    catalogue_->AddStop(stop_requests[index]->at("name"s).AsString(),
+                        stop_coordinates[index]);
+  }
 
   // add road distances
   for (const auto& request : requests_.base_requests) {
@@ -105,84 +130,193 @@ void JsonReader::ParseBaseRequests() {
   }
 }
 
-json::Document JsonReader::ParseStatRequests() {
-  router::TransportRouter router(
-      requests_.routing_settings.at("bus_velocity").AsDouble(),
-      requests_.routing_settings.at("bus_wait_time").AsInt(), *catalogue_);
-  RequestHandler handler{*catalogue_, renderer_, router};
+// The catalogue is complete once base requests are loaded, so the router
+// is built from it on another thread while requests that do not route are
+// answered.
+RequestHandler::RouterFuture JsonReader::StartRouterBuild() const {
+  return std::async(std::launch::async,
+                    [settings = ParseRoutingSettings(), this] {
+                      return std::make_unique<const router::TransportRouter>(
+                          settings, *catalogue_);
+                    })
+      .share();
+}
 
-  json::Builder builder;
-  builder.StartArray();
+json::Document JsonReader::ParseStatRequests(
+    RequestHandler::RouterFuture router) {
+  RequestHandler handler{*catalogue_, renderer_, std::move(router)};
+  const size_t request_count = requests_.stat_requests.size();
+  // Requests of unknown types get no response.
+  std::vector<std::optional<json::Dict>> responses(request_count);
+
+  for (size_t index = 0; index < request_count; ++index) {
+    const auto& request_as_map = requests_.stat_requests[index].AsMap();
+    const std::string& type = request_as_map.at("type"s).AsString();
+    if (type == "Bus"s || type == "Stop"s || type == "Map"s) {
+      responses[index] = AnswerCatalogueRequest(handler, request_as_map);
+    }
+  }
 
-  for (const auto& request : requests_.stat_requests) {
-    auto request_as_map = request.AsMap();
+  // The rest wait for the router. Route requests are answered in runs
+  // that end at each RouterStats request, so the stats count the routes
+  // asked before it and none asked after.
+  size_t run_begin = 0;
+  for (size_t index = 0; index < request_count; ++index) {
+    const auto& request_as_map = requests_.stat_requests[index].AsMap();
+    if (request_as_map.at("type"s).AsString() == "RouterStats"s) {
+      AnswerRouteRequests(handler, run_begin, index, responses);
+      responses[index] =
+          handler.GetRouterStats(request_as_map.at("id"s).AsInt());
+      run_begin = index + 1;
+    }
+  }
+  AnswerRouteRequests(handler, run_begin, request_count, responses);
+
+  for (size_t index = 0; index < request_count; ++index) {
+    auto request_as_map = requests_.stat_requests[index].AsMap();
     int id = request_as_map.at("id"s).AsInt();
     std::string type = request_as_map.at("type"s).AsString();
 
-    if (type == "Bus"s) {
-      std::string name = request_as_map.at("name"s).AsString();
-      auto stat = handler.GetBusStat(name);
-
-      builder.StartDict().Key("request_id").Value(id);
-
-      if (!stat.has_value()) {
-        builder.Key("error_message").Value("not found");
-      } else {
-        builder.Key("curvature")
-            .Value(stat->curvature)
-            .Key("route_length")
-            .Value((int)stat->route_length)
-            .Key("stop_count")
-            .Value((int)stat->stops)
-            .Key("unique_stop_count")
-            .Value((int)stat->unique_stops.size());
+    if (type == "Matrix"s) {
+      std::vector<std::string_view> from_stops;
+      for (const auto& stop : request_as_map.at("sources"s).AsArray()) {
+        from_stops.push_back(catalogue_->FindStop(stop.AsString())->id);
       }
-      builder.EndDict();
-    } else if (type == "Stop"s) {
-      std::string name = request_as_map.at("name"s).AsString();
-      auto stat = handler.GetBusesByStop(name);
-
-      builder.StartDict().Key("request_id").Value(id);
-
-      if (stat == nullptr) {
-        builder.Key("error_message").Value("not found");
-      } else {
-        builder.Key("buses");
-        builder.StartArray();
-        for (auto bus : *stat) {
-          std::string str_bus(bus);
-          builder.Value(str_bus);
-        }
-        builder.EndArray();
+      std::vector<std::string_view> to_stops;
+      for (const auto& stop : request_as_map.at("targets"s).AsArray()) {
+        to_stops.push_back(catalogue_->FindStop(stop.AsString())->id);
       }
-      builder.EndDict();
-    } else if (type == "Map"s) {
-      builder.StartDict().Key("request_id").Value(id);
 
-      std::ostringstream map_output;
-      handler.RenderMap().Render(map_output);
-      json::Node val(map_output.str());
-
-      builder.Key("map").Value(val.AsString());
-      builder.EndDict();
-    } else if (type == "Route"s) {
+      responses[index] =
+          handler.BuildTravelTimeMatrix(from_stops, to_stops, id);
+    } else if (type == "Reachable"s) {
       std::string from_stop_raw_name = request_as_map.at("from"s).AsString();
-      std::string to_stop_raw_name = request_as_map.at("to"s).AsString();
-
       const Stop* from_stop = catalogue_->FindStop(from_stop_raw_name);
-      const Stop* to_stop = catalogue_->FindStop(to_stop_raw_name);
+      double max_time = request_as_map.at("max_time"s).AsDouble();
 
-      json::Dict routing_result =
-          handler.FindRoute(from_stop->id, to_stop->id, id);
-      builder.Value(routing_result);
+      responses[index] =
+          handler.FindReachableStops(from_stop->id, max_time, id);
     }
   }
 
+  json::Builder builder;
+  builder.StartArray();
+  for (auto& response : responses) {
+    if (response) {
+      builder.Value(std::move(*response));
+    }
+  }
   builder.EndArray();
 
   return json::Document{builder.Build()};
 }
 
+json::Dict JsonReader::AnswerCatalogueRequest(
+    const RequestHandler& handler, const json::Dict& request) const {
+  int id = request.at("id"s).AsInt();
+  std::string type = request.at("type"s).AsString();
+
+  json::Builder builder;
+  builder.StartDict().Key("request_id").Value(id);
+  if (type == "Bus"s) {
+    std::string name = request.at("name"s).AsString();
+    auto stat = handler.GetBusStat(name);
+
+    if (!stat.has_value()) {
+      builder.Key("error_message").Value("not found");
+    } else {
+      builder.Key("curvature")
+          .Value(stat->curvature)
+          .Key("route_length")
+          .Value((int)stat->route_length)
+          .Key("stop_count")
+          .Value((int)stat->stops)
+          .Key("unique_stop_count")
+          .Value((int)stat->unique_stops.size());
+    }
+  } else if (type == "Stop"s) {
+    std::string name = request.at("name"s).AsString();
+    auto stat = handler.GetBusesByStop(name);
+
+    if (stat == nullptr) {
+      builder.Key("error_message").Value("not found");
+    } else {
+      builder.Key("buses");
+      builder.StartArray();
+      for (auto bus : *stat) {
+        std::string str_bus(bus);
+        builder.Value(str_bus);
+      }
+      builder.EndArray();
+    }
+  } else if (type == "Map"s) {
+    std::ostringstream map_output;
+    handler.RenderMap().Render(map_output);
+    builder.Key("map").Value(map_output.str());
+  }
+  builder.EndDict();
+  return builder.Build().AsMap();
+}
+
+// Answers the Route requests among stat_requests[begin, end). They are
+// grouped by origin (and transfer limit) so that every group is answered
+// from one search; Pareto requests and requests for alternatives are
+// answered one by one. Responses go to the same indices of responses.
+void JsonReader::AnswerRouteRequests(
+    RequestHandler& handler, size_t begin, size_t end,
+    std::vector<std::optional<json::Dict>>& responses) const {
+  struct RouteBatch {
+    std::vector<std::string_view> to_stops;
+    std::vector<int> request_ids;
+    std::vector<size_t> indices;
+  };
+  std::map<std::pair<std::string_view, std::optional<size_t>>, RouteBatch>
+      batches;
+  for (size_t index = begin; index < end; ++index) {
+    const auto& request_as_map = requests_.stat_requests[index].AsMap();
+    if (request_as_map.at("type"s).AsString() != "Route"s) {
+      continue;
+    }
+    const Stop* from_stop =
+        catalogue_->FindStop(request_as_map.at("from"s).AsString());
+    const Stop* to_stop =
+        catalogue_->FindStop(request_as_map.at("to"s).AsString());
+
+    std::optional<size_t> max_transfers;
+    if (request_as_map.count("max_transfers"s)) {
+      max_transfers = std::max(0, request_as_map.at("max_transfers"s).AsInt());
+    }
+    if (request_as_map.count("pareto"s) &&
+        request_as_map.at("pareto"s).AsBool()) {
+      responses[index] = handler.FindParetoRoutes(
+          from_stop->id, to_stop->id, request_as_map.at("id"s).AsInt(),
+          max_transfers);
+      continue;
+    }
+    if (request_as_map.count("alternatives"s)) {
+      const size_t max_count =
+          std::max(1, request_as_map.at("alternatives"s).AsInt());
+      responses[index] = handler.FindAlternativeRoutes(
+          from_stop->id, to_stop->id, request_as_map.at("id"s).AsInt(),
+          max_count, max_transfers);
+      continue;
+    }
+
+    RouteBatch& batch = batches[{from_stop->id, max_transfers}];
+    batch.to_stops.push_back(to_stop->id);
+    batch.request_ids.push_back(request_as_map.at("id"s).AsInt());
+    batch.indices.push_back(index);
+  }
+
+  for (auto& [origin, batch] : batches) {
+    std::vector<json::Dict> batch_responses = handler.FindRoutes(
+        origin.first, batch.to_stops, batch.request_ids, origin.second);
+    for (size_t i = 0; i < batch.indices.size(); ++i) {
+      responses[batch.indices[i]] = std::move(batch_responses[i]);
+    }
+  }
+}
+
 void JsonReader::ParseRenderSettings() {
   renderer::RenderSettings settings;
   for (const auto& [setting, value] : requests_.render_settings) {
@@ -249,6 +383,84 @@ void JsonReader::ParseRenderSettings() {
   renderer_.SetSettings(settings);
 }
 
+router::RoutingSettings JsonReader::ParseRoutingSettings() const {
+  router::RoutingSettings settings;
+  settings.bus_velocity =
+      requests_.routing_settings.at("bus_velocity"s).AsDouble();
+  settings.bus_wait_time =
+      requests_.routing_settings.at("bus_wait_time"s).AsInt();
+  for (const auto& [setting, value] : requests_.routing_settings) {
+    if (setting == "router_engine"s) {
+      const std::string& engine = value.AsString();
+      if (engine == "all_pairs"s) {
+        settings.engine = router::EngineType::ALL_PAIRS;
+      } else if (engine == "dijkstra"s) {
+        settings.engine = router::EngineType::DIJKSTRA;
+      } else if (engine == "astar"s) {
+        settings.engine = router::EngineType::A_STAR;
+      } else if (engine == "contraction_hierarchies"s) {
+        settings.engine = router::EngineType::CONTRACTION_HIERARCHY;
+      } else if (engine == "raptor"s) {
+        settings.engine = router::EngineType::RAPTOR;
+      } else if (engine == "hub_labels"s) {
+        settings.engine = router::EngineType::HUB_LABELS;
+      } else {
+        throw std::invalid_argument("unknown router engine: "s + engine);
+      }
+    }
+    if (setting == "matrix_weights"s) {
+      const std::string& matrix_weight = value.AsString();
+      if (matrix_weight == "double"s) {
+        settings.matrix_weight = router::MatrixWeightType::DOUBLE;
+      } else if (matrix_weight == "float"s) {
+        settings.matrix_weight = router::MatrixWeightType::FLOAT;
+      } else if (matrix_weight == "fixed_point"s) {
+        settings.matrix_weight = router::MatrixWeightType::FIXED_POINT;
+      } else {
+        throw std::invalid_argument("unknown matrix weight type: "s +
+                                    matrix_weight);
+      }
+    }
+    if (setting == "graph_model"s) {
+      const std::string& graph_model = value.AsString();
+      if (graph_model == "stop_pairs"s) {
+        settings.graph_model = router::GraphModel::STOP_PAIRS;
+      } else if (graph_model == "route_expanded"s) {
+        settings.graph_model = router::GraphModel::ROUTE_EXPANDED;
+      } else {
+        throw std::invalid_argument("unknown graph model: "s + graph_model);
+      }
+    }
+    if (setting == "vertex_order"s) {
+      const std::string& vertex_order = value.AsString();
+      if (vertex_order == "catalogue"s) {
+        settings.vertex_order = router::VertexOrder::CATALOGUE;
+      } else if (vertex_order == "hilbert"s) {
+        settings.vertex_order = router::VertexOrder::HILBERT;
+      } else {
+        throw std::invalid_argument("unknown vertex order: "s + vertex_order);
+      }
+    }
+    if (setting == "prune_parallel_edges"s) {
+      settings.prune_parallel_edges = value.AsBool();
+    }
+    if (setting == "router_threads"s) {
+      settings.thread_count = std::max(1, value.AsInt());
+    }
+    if (setting == "route_cache_size"s) {
+      settings.route_cache_size = std::max(0, value.AsInt());
+    }
+    if (setting == "alternatives_stretch"s) {
+      settings.alternatives_stretch = std::max(1.0, value.AsDouble());
+    }
+    if (setting == "router_cache_file"s) {
+      settings.router_cache_file = value.AsString();
+    }
+  }
+
+  return settings;
+}
+
 svg::Rgb JsonReader::ArrayToRgb(const json::Node& node) {
   auto node_arr = node.AsArray();
   svg::Rgb result;
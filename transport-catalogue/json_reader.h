@@ -3,9 +3,11 @@
 #include <cassert>
 #include <cstddef>
 #include <istream>
+#include <optional>
 #include <ostream>
 #include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "graph.h"
 #include "json.h"
@@ -33,8 +35,15 @@ class JsonReader {
 
   RequestsInfo DivideRequests();
   void ParseBaseRequests();
-  json::Document ParseStatRequests();
+  RequestHandler::RouterFuture StartRouterBuild() const;
+  json::Document ParseStatRequests(RequestHandler::RouterFuture router);
+  json::Dict AnswerCatalogueRequest(const RequestHandler &handler,
+                                    const json::Dict &request) const;
+  void AnswerRouteRequests(
+      RequestHandler &handler, size_t begin, size_t end,
+      std::vector<std::optional<json::Dict>> &responses) const;
   void ParseRenderSettings();
+  router::RoutingSettings ParseRoutingSettings() const;
 
   svg::Rgb ArrayToRgb(const json::Node &node);
   svg::Rgba ArrayToRgba(const json::Node &node);
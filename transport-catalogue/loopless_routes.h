@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+#include "router.h"
+#include "search_state.h"
+
+namespace graph {
+
+// Yields the loopless routes between two vertices one by one in order of
+// weight (Yen's algorithm). Every route after the first branches off an
+// already yielded one at some vertex: the spur search from there may
+// neither revisit the shared prefix nor take the next edge of any yielded
+// route with that prefix. Spur searches are Dijkstra bounded by the max
+// weight, so a query costs about one bounded search per edge of each
+// yielded route, never an all-pairs precompute. A potential, under the
+// same terms as DijkstraRouter's, turns them into A* and tightens the
+// bound.
+template <typename Weight>
+class LooplessRouteEnumerator {
+   private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+   public:
+    using RouteInfo = typename RouterEngine<Weight>::RouteInfo;
+    using Potential = std::function<Weight(VertexId vertex, VertexId target)>;
+
+    LooplessRouteEnumerator(const Graph& graph, VertexId from, VertexId to,
+                            Potential potential = {});
+
+    // Routes heavier than max_weight are not yielded; meant to be set once
+    // the first, shortest route is known.
+    void SetMaxWeight(Weight max_weight) { max_weight_ = max_weight; }
+
+    // The next route in order of weight, or nullopt when none is left.
+    std::optional<RouteInfo> Next();
+
+   private:
+    struct QueryState {
+        SearchState<Weight> search;
+        std::vector<Weight> potentials;
+        std::vector<uint32_t> vertex_bans;
+        std::vector<uint32_t> edge_bans;
+        uint32_t ban_stamp = 0;
+    };
+
+    // Scratch buffers are shared by all enumerators running on one thread.
+    static QueryState& GetQueryState() {
+        static thread_local QueryState state;
+        return state;
+    }
+
+    void ClearBans(QueryState& state) const;
+    void AddSpurRoutes(const RouteInfo& route);
+    std::optional<std::vector<EdgeId>> FindSpurRoute(QueryState& state,
+                                                     VertexId spur,
+                                                     Weight max_weight) const;
+    Weight GetRouteWeight(const std::vector<EdgeId>& edges) const;
+
+    static constexpr Weight ZERO_WEIGHT{};
+    const Graph& graph_;
+    VertexId from_;
+    VertexId to_;
+    Potential potential_;
+    Weight max_weight_ = std::numeric_limits<Weight>::max();
+    bool is_started_ = false;
+    std::vector<RouteInfo> routes_;
+    // Ordered by weight, ties by edges, so the order is deterministic and
+    // a route found from two branches is kept once.
+    std::set<std::pair<Weight, std::vector<EdgeId>>> candidates_;
+};
+
+template <typename Weight>
+LooplessRouteEnumerator<Weight>::LooplessRouteEnumerator(const Graph& graph,
+                                                         VertexId from,
+                                                         VertexId to,
+                                                         Potential potential)
+    : graph_(graph), from_(from), to_(to), potential_(std::move(potential)) {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+}
+
+template <typename Weight>
+std::optional<typename LooplessRouteEnumerator<Weight>::RouteInfo>
+LooplessRouteEnumerator<Weight>::Next() {
+    if (!is_started_) {
+        is_started_ = true;
+        QueryState& state = GetQueryState();
+        ClearBans(state);
+        if (auto edges = FindSpurRoute(state, from_, max_weight_)) {
+            candidates_.emplace(GetRouteWeight(*edges), std::move(*edges));
+        }
+    } else if (!routes_.empty()) {
+        // Branches of a route are searched only once the next route is
+        // asked for, with the max weight known by then.
+        AddSpurRoutes(routes_.back());
+    }
+
+    if (candidates_.empty() || max_weight_ < candidates_.begin()->first) {
+        candidates_.clear();
+        return std::nullopt;
+    }
+    auto candidate = candidates_.extract(candidates_.begin());
+    routes_.push_back(
+        {candidate.value().first, std::move(candidate.value().second)});
+    return routes_.back();
+}
+
+template <typename Weight>
+void LooplessRouteEnumerator<Weight>::ClearBans(QueryState& state) const {
+    if (state.vertex_bans.size() < graph_.GetVertexCount()) {
+        state.vertex_bans.resize(graph_.GetVertexCount(), 0);
+    }
+    if (state.edge_bans.size() < graph_.GetEdgeCount()) {
+        state.edge_bans.resize(graph_.GetEdgeCount(), 0);
+    }
+    if (++state.ban_stamp == 0) {
+        std::fill(state.vertex_bans.begin(), state.vertex_bans.end(), 0);
+        std::fill(state.edge_bans.begin(), state.edge_bans.end(), 0);
+        state.ban_stamp = 1;
+    }
+}
+
+template <typename Weight>
+void LooplessRouteEnumerator<Weight>::AddSpurRoutes(const RouteInfo& route) {
+    QueryState& state = GetQueryState();
+    Weight root_weight = ZERO_WEIGHT;
+    for (size_t spur_index = 0; spur_index < route.edges.size();
+         ++spur_index) {
+        if (max_weight_ < root_weight) {
+            break;
+        }
+        ClearBans(state);
+        for (size_t i = 0; i < spur_index; ++i) {
+            state.vertex_bans[graph_.GetEdge(route.edges[i]).from] =
+                state.ban_stamp;
+        }
+        for (const RouteInfo& other : routes_) {
+            if (other.edges.size() > spur_index &&
+                std::equal(route.edges.begin(),
+                           route.edges.begin() + spur_index,
+                           other.edges.begin())) {
+                state.edge_bans[other.edges[spur_index]] = state.ban_stamp;
+            }
+        }
+
+        const VertexId spur = graph_.GetEdge(route.edges[spur_index]).from;
+        if (auto spur_edges =
+                FindSpurRoute(state, spur, max_weight_ - root_weight)) {
+            std::vector<EdgeId> edges(route.edges.begin(),
+                                      route.edges.begin() + spur_index);
+            edges.insert(edges.end(), spur_edges->begin(), spur_edges->end());
+            const Weight weight = GetRouteWeight(edges);
+            candidates_.emplace(weight, std::move(edges));
+        }
+        root_weight += graph_.GetEdge(route.edges[spur_index]).weight;
+    }
+}
+
+template <typename Weight>
+std::optional<std::vector<EdgeId>>
+LooplessRouteEnumerator<Weight>::FindSpurRoute(QueryState& state,
+                                               VertexId spur,
+                                               Weight max_weight) const {
+    SearchState<Weight>& search = state.search;
+    std::vector<Weight>& potentials = state.potentials;
+    search.Prepare(graph_.GetVertexCount());
+    if (potential_ && potentials.size() < graph_.GetVertexCount()) {
+        potentials.resize(graph_.GetVertexCount());
+    }
+
+    // Vertices that cannot be on a route within max_weight stay unreached.
+    const auto reach = [&](VertexId vertex, Weight weight, EdgeId prev_edge) {
+        Weight key = weight;
+        if (potential_) {
+            if (!search.IsReached(vertex)) {
+                potentials[vertex] = potential_(vertex, to_);
+            }
+            key += potentials[vertex];
+        }
+        if (max_weight < key) {
+            return;
+        }
+        search.Reach(vertex, weight, prev_edge);
+        search.Push(key, weight, vertex);
+    };
+
+    reach(spur, ZERO_WEIGHT, NO_EDGE);
+    bool is_found = false;
+    while (!search.queue.empty()) {
+        const auto item = search.Pop();
+        if (search.IsStale(item)) {
+            continue;
+        }
+        ++search.settled_count;
+        if (item.vertex == to_) {
+            is_found = true;
+            break;
+        }
+        graph_.ForEachOutgoingArc(item.vertex, [&](const Arc<Weight>& arc) {
+            if (state.vertex_bans[arc.to] == state.ban_stamp ||
+                state.edge_bans[arc.edge_id] == state.ban_stamp) {
+                return;
+            }
+            const Weight candidate_weight = item.weight + arc.weight;
+            if (!search.IsReached(arc.to) ||
+                candidate_weight < search.weights[arc.to]) {
+                reach(arc.to, candidate_weight, arc.edge_id);
+            }
+        });
+    }
+    if (!is_found) {
+        return std::nullopt;
+    }
+
+    std::vector<EdgeId> edges;
+    for (EdgeId edge_id = search.prev_edges[to_]; edge_id != NO_EDGE;
+         edge_id = search.prev_edges[graph_.GetEdge(edge_id).from]) {
+        edges.push_back(edge_id);
+    }
+    std::reverse(edges.begin(), edges.end());
+    return edges;
+}
+
+// Summed from the first edge on, as every search sums them, so a route's
+// weight does not depend on the branch it was found from.
+template <typename Weight>
+Weight LooplessRouteEnumerator<Weight>::GetRouteWeight(
+    const std::vector<EdgeId>& edges) const {
+    Weight weight = ZERO_WEIGHT;
+    for (const EdgeId edge_id : edges) {
+        weight += graph_.GetEdge(edge_id).weight;
+    }
+    return weight;
+}
+
+}  // namespace graph
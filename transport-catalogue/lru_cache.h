@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace caching {
+
+struct CacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+};
+
+// Bounded map that evicts the least recently used entry once it holds
+// capacity entries. All methods may be called from several threads.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+   public:
+    // A cache of zero capacity stores nothing.
+    explicit LruCache(size_t capacity) : capacity_(capacity) {}
+
+    // Returns a copy of the cached value and marks it most recently used.
+    std::optional<Value> Get(const Key& key) {
+        std::lock_guard lock(mutex_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            ++stats_.misses;
+            return std::nullopt;
+        }
+        ++stats_.hits;
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    void Put(const Key& key, Value value) {
+        if (capacity_ == 0) {
+            return;
+        }
+        std::lock_guard lock(mutex_);
+        if (auto it = index_.find(key); it != index_.end()) {
+            it->second->second = std::move(value);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        if (entries_.size() == capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+            ++stats_.evictions;
+        }
+        entries_.emplace_front(key, std::move(value));
+        index_[key] = entries_.begin();
+    }
+
+    void Clear() {
+        std::lock_guard lock(mutex_);
+        entries_.clear();
+        index_.clear();
+    }
+
+    size_t GetCapacity() const { return capacity_; }
+
+    CacheStats GetStats() const {
+        std::lock_guard lock(mutex_);
+        return stats_;
+    }
+
+   private:
+    using Entry = std::pair<Key, Value>;
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index_;
+    CacheStats stats_;
+};
+
+}  // namespace caching
@@ -0,0 +1,54 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+namespace memory {
+
+std::unique_ptr<const MappedFile> MappedFile::Open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return nullptr;
+        }
+        throw std::runtime_error("cannot open " + path + ": " +
+                                 std::strerror(errno));
+    }
+    struct stat file_stat {};
+    if (::fstat(fd, &file_stat) != 0) {
+        const int error = errno;
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path + ": " +
+                                 std::strerror(error));
+    }
+    const size_t size = static_cast<size_t>(file_stat.st_size);
+    if (size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed.
+    const int error = errno;
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("cannot map " + path + ": " +
+                                 std::strerror(error));
+    }
+    return std::unique_ptr<const MappedFile>(
+        new MappedFile(static_cast<const std::byte*>(data), size));
+}
+
+MappedFile::MappedFile(const std::byte* data, size_t size)
+    : data_(data), size_(size) {}
+
+MappedFile::~MappedFile() {
+    ::munmap(const_cast<std::byte*>(data_), size_);
+}
+
+}  // namespace memory
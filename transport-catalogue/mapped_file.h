@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace memory {
+
+// Read-only memory mapping of a whole file. Pages are loaded on first
+// access and shared with every other process mapping the same file.
+class MappedFile {
+   public:
+    // Returns nullptr when the file does not exist or is empty. Throws
+    // std::runtime_error when it exists but cannot be mapped.
+    static std::unique_ptr<const MappedFile> Open(const std::string& path);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const std::byte* GetData() const { return data_; }
+    size_t GetSize() const { return size_; }
+
+   private:
+    MappedFile(const std::byte* data, size_t size);
+
+    const std::byte* data_;
+    size_t size_;
+};
+
+}  // namespace memory
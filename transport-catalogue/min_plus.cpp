@@ -0,0 +1,139 @@
+#include "min_plus.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MIN_PLUS_HAS_AVX2_KERNEL
+#include <immintrin.h>
+#endif
+
+namespace graph {
+
+namespace {
+
+#ifdef MIN_PLUS_HAS_AVX2_KERNEL
+
+__attribute__((target("avx2"))) void RelaxRowAvx2(
+    float weight_from, uint32_t prev_edge_from, const float* through_weights,
+    const uint32_t* through_prev_edges, float* weights, uint32_t* prev_edges,
+    size_t count, float infinite_weight, uint32_t no_edge) {
+    const __m256 from = _mm256_set1_ps(weight_from);
+    const __m256i prev_from = _mm256_set1_epi32(static_cast<int>(prev_edge_from));
+    const __m256i none = _mm256_set1_epi32(static_cast<int>(no_edge));
+    size_t j = 0;
+    for (; j + 8 <= count; j += 8) {
+        const __m256 candidate =
+            _mm256_add_ps(from, _mm256_loadu_ps(through_weights + j));
+        const __m256 current = _mm256_loadu_ps(weights + j);
+        const __m256 is_better = _mm256_cmp_ps(candidate, current, _CMP_LT_OQ);
+        if (_mm256_movemask_ps(is_better) == 0) {
+            continue;
+        }
+        // Only the improved lanes are written: the lane of the vertex the
+        // row is relaxed through never improves, and other tiles running
+        // at the same time read it.
+        const __m256i store_mask = _mm256_castps_si256(is_better);
+        _mm256_maskstore_ps(weights + j, store_mask, candidate);
+
+        const __m256i through_prev = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(through_prev_edges + j));
+        const __m256i new_prev = _mm256_blendv_epi8(
+            through_prev, prev_from, _mm256_cmpeq_epi32(through_prev, none));
+        _mm256_maskstore_epi32(reinterpret_cast<int*>(prev_edges + j),
+                               store_mask, new_prev);
+    }
+    MinPlusRelaxRowScalar(weight_from, prev_edge_from, through_weights + j,
+                          through_prev_edges + j, weights + j, prev_edges + j,
+                          count - j, infinite_weight, no_edge);
+}
+
+__attribute__((target("avx2"))) void RelaxRowAvx2(
+    double weight_from, uint32_t prev_edge_from, const double* through_weights,
+    const uint32_t* through_prev_edges, double* weights, uint32_t* prev_edges,
+    size_t count, double infinite_weight, uint32_t no_edge) {
+    const __m256d from = _mm256_set1_pd(weight_from);
+    const __m128i prev_from = _mm_set1_epi32(static_cast<int>(prev_edge_from));
+    const __m128i none = _mm_set1_epi32(static_cast<int>(no_edge));
+    // Gathers the low halves of the four 64-bit mask lanes into the lower
+    // 128 bits, matching the 32-bit edge id lanes.
+    const __m256i pack_mask = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    size_t j = 0;
+    for (; j + 4 <= count; j += 4) {
+        const __m256d candidate =
+            _mm256_add_pd(from, _mm256_loadu_pd(through_weights + j));
+        const __m256d current = _mm256_loadu_pd(weights + j);
+        const __m256d is_better = _mm256_cmp_pd(candidate, current, _CMP_LT_OQ);
+        if (_mm256_movemask_pd(is_better) == 0) {
+            continue;
+        }
+        // Only the improved lanes are written, as in the float kernel.
+        _mm256_maskstore_pd(weights + j, _mm256_castpd_si256(is_better),
+                            candidate);
+
+        const __m128i is_better_edges =
+            _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(
+                _mm256_castpd_si256(is_better), pack_mask));
+        const __m128i through_prev = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(through_prev_edges + j));
+        const __m128i new_prev = _mm_blendv_epi8(
+            through_prev, prev_from, _mm_cmpeq_epi32(through_prev, none));
+        _mm_maskstore_epi32(reinterpret_cast<int*>(prev_edges + j),
+                            is_better_edges, new_prev);
+    }
+    MinPlusRelaxRowScalar(weight_from, prev_edge_from, through_weights + j,
+                          through_prev_edges + j, weights + j, prev_edges + j,
+                          count - j, infinite_weight, no_edge);
+}
+
+bool DetectAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+bool DetectAvx2() { return false; }
+
+#endif
+
+template <typename Weight>
+using RelaxRowKernel = void (*)(Weight, uint32_t, const Weight*,
+                                const uint32_t*, Weight*, uint32_t*, size_t,
+                                Weight, uint32_t);
+
+template <typename Weight>
+RelaxRowKernel<Weight> SelectKernel() {
+#ifdef MIN_PLUS_HAS_AVX2_KERNEL
+    if (DetectAvx2()) {
+        return &RelaxRowAvx2;
+    }
+#endif
+    return &MinPlusRelaxRowScalar<Weight>;
+}
+
+}  // namespace
+
+bool HasVectorMinPlusKernel() {
+    static const bool has_avx2 = DetectAvx2();
+    return has_avx2;
+}
+
+void MinPlusRelaxRow(float weight_from, uint32_t prev_edge_from,
+                     const float* through_weights,
+                     const uint32_t* through_prev_edges, float* weights,
+                     uint32_t* prev_edges, size_t count, float infinite_weight,
+                     uint32_t no_edge) {
+    static const RelaxRowKernel<float> kernel = SelectKernel<float>();
+    kernel(weight_from, prev_edge_from, through_weights, through_prev_edges,
+           weights, prev_edges, count, infinite_weight, no_edge);
+}
+
+void MinPlusRelaxRow(double weight_from, uint32_t prev_edge_from,
+                     const double* through_weights,
+                     const uint32_t* through_prev_edges, double* weights,
+                     uint32_t* prev_edges, size_t count,
+                     double infinite_weight, uint32_t no_edge) {
+    static const RelaxRowKernel<double> kernel = SelectKernel<double>();
+    kernel(weight_from, prev_edge_from, through_weights, through_prev_edges,
+           weights, prev_edges, count, infinite_weight, no_edge);
+}
+
+}  // namespace graph
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace graph {
+
+// Min-plus update of one all-pairs matrix row segment, the inner loop of
+// Floyd-Warshall. For every column j with a finite through_weights[j]:
+//
+//   if weight_from + through_weights[j] < weights[j]:
+//       weights[j] = weight_from + through_weights[j]
+//       prev_edges[j] = through_prev_edges[j] != no_edge
+//                           ? through_prev_edges[j] : prev_edge_from
+//
+// Missing routes are marked by infinite_weight, and weight_from must be
+// finite. Integer sums past infinite_weight are never accepted.
+template <typename Weight>
+void MinPlusRelaxRowScalar(Weight weight_from, uint32_t prev_edge_from,
+                           const Weight* through_weights,
+                           const uint32_t* through_prev_edges, Weight* weights,
+                           uint32_t* prev_edges, size_t count,
+                           Weight infinite_weight, uint32_t no_edge) {
+    for (size_t j = 0; j < count; ++j) {
+        const Weight weight_to = through_weights[j];
+        if (weight_to == infinite_weight) {
+            continue;
+        }
+        if constexpr (std::is_integral_v<Weight>) {
+            // The sum would wrap around, and it is past every stored
+            // weight anyway.
+            if (weight_to > infinite_weight - weight_from) {
+                continue;
+            }
+        }
+        const Weight candidate_weight = weight_from + weight_to;
+        if (candidate_weight < weights[j]) {
+            weights[j] = candidate_weight;
+            prev_edges[j] = through_prev_edges[j] != no_edge
+                                ? through_prev_edges[j]
+                                : prev_edge_from;
+        }
+    }
+}
+
+template <typename Weight>
+void MinPlusRelaxRow(Weight weight_from, uint32_t prev_edge_from,
+                     const Weight* through_weights,
+                     const uint32_t* through_prev_edges, Weight* weights,
+                     uint32_t* prev_edges, size_t count,
+                     Weight infinite_weight, uint32_t no_edge) {
+    MinPlusRelaxRowScalar(weight_from, prev_edge_from, through_weights,
+                          through_prev_edges, weights, prev_edges, count,
+                          infinite_weight, no_edge);
+}
+
+// Floating-point rows use an AVX2 kernel when the CPU supports it. Infinite
+// weights need no special casing there since inf + x is never less than
+// anything, so results are bit-identical to the scalar loop.
+void MinPlusRelaxRow(float weight_from, uint32_t prev_edge_from,
+                     const float* through_weights,
+                     const uint32_t* through_prev_edges, float* weights,
+                     uint32_t* prev_edges, size_t count, float infinite_weight,
+                     uint32_t no_edge);
+void MinPlusRelaxRow(double weight_from, uint32_t prev_edge_from,
+                     const double* through_weights,
+                     const uint32_t* through_prev_edges, double* weights,
+                     uint32_t* prev_edges, size_t count,
+                     double infinite_weight, uint32_t no_edge);
+
+bool HasVectorMinPlusKernel();
+
+}  // namespace graph
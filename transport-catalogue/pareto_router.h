@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "graph.h"
+#include "search_state.h"
+
+namespace graph {
+
+// Bicriteria routes: the Pareto set of routes minimizing both the weight
+// and the number of counted edges (boardings, say). Labels are popped in
+// order of (weight, count), so a vertex's labels settle with ever smaller
+// counts and dominance is a single comparison against the smallest count
+// settled there. Labels live in one pool reused by every search on the
+// thread and point to their parent by index.
+template <typename Weight>
+class ParetoRouter {
+   private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+   public:
+    struct Route {
+        Weight weight;
+        size_t count;
+        std::vector<EdgeId> edges;
+    };
+
+    // counted_edges[edge_id] tells whether the edge adds one to the count.
+    ParetoRouter(const Graph& graph, const std::vector<bool>& counted_edges);
+
+    // Routes from the fastest to the one with the fewest counted edges, no
+    // two with the same count. Routes with more than max_count counted
+    // edges are left out.
+    std::vector<Route> BuildRoutes(
+        VertexId from, VertexId to,
+        size_t max_count = std::numeric_limits<size_t>::max()) const;
+
+    // Labels created by the last search run on the calling thread.
+    static size_t GetLastLabelCount() {
+        return GetQueryState().labels.size();
+    }
+
+   private:
+    static constexpr uint32_t NO_LABEL = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t NO_COUNT = std::numeric_limits<uint32_t>::max();
+
+    struct Label {
+        Weight weight;
+        uint32_t count;
+        VertexId vertex;
+        EdgeId prev_edge;
+        uint32_t parent;
+    };
+
+    struct QueueItem {
+        Weight weight;
+        uint32_t count;
+        uint32_t label;
+
+        bool operator>(const QueueItem& other) const {
+            if (weight != other.weight) {
+                return weight > other.weight;
+            }
+            return count > other.count;
+        }
+    };
+
+    // min_counts[vertex] is valid only while its stamp is the current one.
+    struct QueryState {
+        std::vector<Label> labels;
+        std::vector<QueueItem> queue;
+        std::vector<uint32_t> min_counts;
+        std::vector<uint32_t> stamps;
+        uint32_t stamp = 0;
+
+        void Prepare(size_t vertex_count) {
+            if (stamps.size() < vertex_count) {
+                min_counts.resize(vertex_count);
+                stamps.resize(vertex_count, 0);
+            }
+            if (++stamp == 0) {
+                std::fill(stamps.begin(), stamps.end(), 0);
+                stamp = 1;
+            }
+            labels.clear();
+            queue.clear();
+        }
+
+        uint32_t GetMinCount(VertexId vertex) const {
+            return stamps[vertex] == stamp ? min_counts[vertex] : NO_COUNT;
+        }
+
+        void Settle(VertexId vertex, uint32_t count) {
+            stamps[vertex] = stamp;
+            min_counts[vertex] = count;
+        }
+
+        void Push(const Label& label) {
+            queue.push_back({label.weight, label.count,
+                             static_cast<uint32_t>(labels.size())});
+            labels.push_back(label);
+            std::push_heap(queue.begin(), queue.end(),
+                           std::greater<QueueItem>());
+        }
+
+        QueueItem Pop() {
+            std::pop_heap(queue.begin(), queue.end(),
+                          std::greater<QueueItem>());
+            const QueueItem item = queue.back();
+            queue.pop_back();
+            return item;
+        }
+    };
+
+    static QueryState& GetQueryState() {
+        static thread_local QueryState state;
+        return state;
+    }
+
+    static constexpr Weight ZERO_WEIGHT{};
+    const Graph& graph_;
+    const std::vector<bool>& counted_edges_;
+};
+
+template <typename Weight>
+ParetoRouter<Weight>::ParetoRouter(const Graph& graph,
+                                   const std::vector<bool>& counted_edges)
+    : graph_(graph), counted_edges_(counted_edges) {
+    if (counted_edges_.size() < graph_.GetEdgeCount()) {
+        throw std::invalid_argument("every edge should be flagged");
+    }
+}
+
+template <typename Weight>
+std::vector<typename ParetoRouter<Weight>::Route>
+ParetoRouter<Weight>::BuildRoutes(VertexId from, VertexId to,
+                                  size_t max_count) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+
+    QueryState& state = GetQueryState();
+    state.Prepare(vertex_count);
+    state.Push({ZERO_WEIGHT, 0, from, NO_EDGE, NO_LABEL});
+    std::vector<uint32_t> target_labels;
+    while (!state.queue.empty()) {
+        const QueueItem item = state.Pop();
+        const Label label = state.labels[item.label];
+        // A label is dominated by any label settled before it at its
+        // vertex or at the target with no larger count.
+        if (label.count >= state.GetMinCount(label.vertex) ||
+            label.count >= state.GetMinCount(to)) {
+            continue;
+        }
+        state.Settle(label.vertex, label.count);
+        if (label.vertex == to) {
+            target_labels.push_back(item.label);
+            continue;
+        }
+        graph_.ForEachOutgoingArc(label.vertex, [&](const Arc<Weight>& arc) {
+            const uint32_t count =
+                label.count + (counted_edges_[arc.edge_id] ? 1 : 0);
+            if (count > max_count || count >= state.GetMinCount(arc.to) ||
+                count >= state.GetMinCount(to)) {
+                return;
+            }
+            state.Push({label.weight + arc.weight, count, arc.to,
+                        arc.edge_id, item.label});
+        });
+    }
+
+    std::vector<Route> routes;
+    routes.reserve(target_labels.size());
+    for (const uint32_t target_label : target_labels) {
+        Route route{state.labels[target_label].weight,
+                    state.labels[target_label].count,
+                    {}};
+        for (uint32_t index = target_label;
+             state.labels[index].parent != NO_LABEL;
+             index = state.labels[index].parent) {
+            route.edges.push_back(state.labels[index].prev_edge);
+        }
+        std::reverse(route.edges.begin(), route.edges.end());
+        routes.push_back(std::move(route));
+    }
+    return routes;
+}
+
+}  // namespace graph
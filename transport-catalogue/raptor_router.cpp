@@ -0,0 +1,282 @@
+#include "raptor_router.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace router {
+namespace {
+constexpr double INFINITE_TIME = std::numeric_limits<double>::infinity();
+constexpr uint32_t NOT_QUEUED = std::numeric_limits<uint32_t>::max();
+}  // namespace
+
+// Round k of the times and labels lives at [k * stop_count, (k + 1) *
+// stop_count) of round_times and round_labels.
+struct RaptorRouter::QueryState {
+  std::vector<double> best_times;
+  std::vector<double> round_times;
+  std::vector<Label> round_labels;
+  std::vector<StopIndex> marked_stops;
+  std::vector<bool> is_marked;
+  std::vector<RouteIndex> queued_routes;
+  std::vector<uint32_t> queued_positions;
+  size_t scanned_route_count = 0;
+  size_t label_count = 0;
+};
+
+RaptorRouter::RaptorRouter(const catalogue::TransportCatalogue& db,
+                           double wait_time, const SegmentTime& segment_time)
+    : wait_time_(wait_time) {
+  for (const auto& stop : *db.GetAllStops()) {
+    stop_indices_[&stop] = static_cast<StopIndex>(stops_.size());
+    stops_.push_back(&stop);
+  }
+
+  route_offsets_.push_back(0);
+  for (const auto& bus : *db.GetAllBuses()) {
+    if (bus.route.size() < 2) {
+      continue;
+    }
+    route_buses_.push_back(&bus);
+    for (size_t i = 0; i < bus.route.size(); ++i) {
+      route_stops_.push_back(stop_indices_.at(bus.route[i]));
+      segment_times_.push_back(
+          i == 0 ? 0.0 : segment_time(bus.route[i - 1], bus.route[i]));
+    }
+    route_offsets_.push_back(route_stops_.size());
+  }
+
+  stop_visit_offsets_.assign(stops_.size() + 1, 0);
+  for (const StopIndex stop : route_stops_) {
+    ++stop_visit_offsets_[stop + 1];
+  }
+  for (size_t stop = 0; stop < stops_.size(); ++stop) {
+    stop_visit_offsets_[stop + 1] += stop_visit_offsets_[stop];
+  }
+  std::vector<size_t> next_visit(stop_visit_offsets_.begin(),
+                                 stop_visit_offsets_.end() - 1);
+  stop_visits_.resize(route_stops_.size());
+  for (RouteIndex route = 0; route < route_buses_.size(); ++route) {
+    for (size_t i = route_offsets_[route]; i < route_offsets_[route + 1];
+         ++i) {
+      stop_visits_[next_visit[route_stops_[i]]++] = {
+          route, static_cast<uint32_t>(i - route_offsets_[route])};
+    }
+  }
+}
+
+RaptorRouter::QueryState& RaptorRouter::GetQueryState() {
+  static thread_local QueryState state;
+  return state;
+}
+
+size_t RaptorRouter::GetLastScannedRouteCount() {
+  return GetQueryState().scanned_route_count;
+}
+
+size_t RaptorRouter::GetLastLabelCount() {
+  return GetQueryState().label_count;
+}
+
+std::optional<RaptorRouter::Journey> RaptorRouter::FindJourney(
+    catalogue::TransportCatalogue::StopPtr from,
+    catalogue::TransportCatalogue::StopPtr to,
+    std::optional<size_t> max_transfers) const {
+  const StopIndex source = stop_indices_.at(from);
+  const StopIndex target = stop_indices_.at(to);
+  const size_t max_rounds =
+      max_transfers ? *max_transfers + 1 : std::numeric_limits<size_t>::max();
+
+  QueryState& state = GetQueryState();
+  const size_t round_count =
+      RunRounds(state, source, target, max_rounds, INFINITE_TIME);
+  if (state.best_times[target] == INFINITE_TIME) {
+    return std::nullopt;
+  }
+  return ExtractJourney(state, round_count, source, target);
+}
+
+std::vector<std::optional<RaptorRouter::Journey>> RaptorRouter::FindJourneys(
+    catalogue::TransportCatalogue::StopPtr from,
+    const std::vector<catalogue::TransportCatalogue::StopPtr>& to,
+    std::optional<size_t> max_transfers) const {
+  const StopIndex source = stop_indices_.at(from);
+  const size_t max_rounds =
+      max_transfers ? *max_transfers + 1 : std::numeric_limits<size_t>::max();
+
+  QueryState& state = GetQueryState();
+  const size_t round_count =
+      RunRounds(state, source, std::nullopt, max_rounds, INFINITE_TIME);
+  std::vector<std::optional<Journey>> journeys(to.size());
+  for (size_t i = 0; i < to.size(); ++i) {
+    const StopIndex target = stop_indices_.at(to[i]);
+    if (state.best_times[target] != INFINITE_TIME) {
+      journeys[i] = ExtractJourney(state, round_count, source, target);
+    }
+  }
+  return journeys;
+}
+
+std::vector<RaptorRouter::Journey> RaptorRouter::FindParetoJourneys(
+    catalogue::TransportCatalogue::StopPtr from,
+    catalogue::TransportCatalogue::StopPtr to,
+    std::optional<size_t> max_transfers) const {
+  const StopIndex source = stop_indices_.at(from);
+  const StopIndex target = stop_indices_.at(to);
+  const size_t max_rounds =
+      max_transfers ? *max_transfers + 1 : std::numeric_limits<size_t>::max();
+
+  QueryState& state = GetQueryState();
+  const size_t round_count =
+      RunRounds(state, source, target, max_rounds, INFINITE_TIME);
+  std::vector<Journey> journeys;
+  if (source == target) {
+    journeys.push_back(ExtractJourney(state, 0, source, target));
+    return journeys;
+  }
+  // A round labels the target only when it improves on every earlier
+  // round, so each labelled round is a Pareto optimal journey.
+  const size_t stop_count = stops_.size();
+  for (size_t round = round_count; round > 0; --round) {
+    if (state.round_labels[round * stop_count + target].route != NO_ROUTE) {
+      journeys.push_back(ExtractJourney(state, round, source, target));
+    }
+  }
+  return journeys;
+}
+
+std::vector<std::pair<catalogue::TransportCatalogue::StopPtr, double>>
+RaptorRouter::FindReachableStops(catalogue::TransportCatalogue::StopPtr from,
+                                 double max_time) const {
+  QueryState& state = GetQueryState();
+  RunRounds(state, stop_indices_.at(from), std::nullopt,
+            std::numeric_limits<size_t>::max(), max_time);
+  std::vector<std::pair<catalogue::TransportCatalogue::StopPtr, double>>
+      result;
+  for (StopIndex stop = 0; stop < stops_.size(); ++stop) {
+    if (state.best_times[stop] != INFINITE_TIME &&
+        state.best_times[stop] <= max_time) {
+      result.emplace_back(stops_[stop], state.best_times[stop]);
+    }
+  }
+  return result;
+}
+
+size_t RaptorRouter::RunRounds(QueryState& state, StopIndex source,
+                               std::optional<StopIndex> target,
+                               size_t max_rounds, double time_limit) const {
+  const size_t stop_count = stops_.size();
+  state.scanned_route_count = 0;
+  state.label_count = 0;
+  state.best_times.assign(stop_count, INFINITE_TIME);
+  state.round_times.assign(stop_count, INFINITE_TIME);
+  state.round_labels.assign(stop_count, {NO_ROUTE, 0, 0, 0.0});
+  state.is_marked.assign(stop_count, false);
+  state.queued_positions.assign(route_buses_.size(), NOT_QUEUED);
+  state.marked_stops.clear();
+
+  state.best_times[source] = 0.0;
+  state.round_times[source] = 0.0;
+  state.is_marked[source] = true;
+  state.marked_stops.push_back(source);
+
+  size_t round = 0;
+  while (!state.marked_stops.empty() && round < max_rounds) {
+    ++round;
+
+    // Each route is scanned once per round, starting from its first stop
+    // that improved in the previous round.
+    state.queued_routes.clear();
+    for (const StopIndex stop : state.marked_stops) {
+      state.is_marked[stop] = false;
+      for (size_t i = stop_visit_offsets_[stop];
+           i < stop_visit_offsets_[stop + 1]; ++i) {
+        const RouteVisit& visit = stop_visits_[i];
+        uint32_t& position = state.queued_positions[visit.route];
+        if (position == NOT_QUEUED) {
+          state.queued_routes.push_back(visit.route);
+          position = visit.position;
+        } else {
+          position = std::min(position, visit.position);
+        }
+      }
+    }
+    state.marked_stops.clear();
+
+    const size_t previous_row = (round - 1) * stop_count;
+    const size_t row = round * stop_count;
+    state.round_times.resize(row + stop_count);
+    state.round_labels.resize(row + stop_count, {NO_ROUTE, 0, 0, 0.0});
+    std::copy_n(state.round_times.begin() + previous_row, stop_count,
+                state.round_times.begin() + row);
+    const double* previous_times = state.round_times.data() + previous_row;
+    double* times = state.round_times.data() + row;
+    Label* labels = state.round_labels.data() + row;
+
+    for (const RouteIndex route : state.queued_routes) {
+      const size_t begin = route_offsets_[route];
+      const size_t end = route_offsets_[route + 1];
+      const size_t first = begin + state.queued_positions[route];
+      state.queued_positions[route] = NOT_QUEUED;
+      ++state.scanned_route_count;
+
+      bool is_boarded = false;
+      uint32_t board_position = 0;
+      double board_time = 0.0;
+      double ride_time = 0.0;
+      for (size_t i = first; i < end; ++i) {
+        const StopIndex stop = route_stops_[i];
+        if (is_boarded) {
+          ride_time += segment_times_[i];
+          const double arrival_time = board_time + ride_time;
+          if (arrival_time < state.best_times[stop] &&
+              arrival_time <= time_limit &&
+              (!target || arrival_time < state.best_times[*target])) {
+            state.best_times[stop] = arrival_time;
+            times[stop] = arrival_time;
+            labels[stop] = {route, board_position,
+                            static_cast<uint32_t>(i - begin), ride_time};
+            ++state.label_count;
+            if (!state.is_marked[stop]) {
+              state.is_marked[stop] = true;
+              state.marked_stops.push_back(stop);
+            }
+          }
+        }
+        if (previous_times[stop] == INFINITE_TIME) {
+          continue;
+        }
+        const double candidate_board_time = previous_times[stop] + wait_time_;
+        if (!is_boarded || candidate_board_time < board_time + ride_time) {
+          is_boarded = true;
+          board_position = static_cast<uint32_t>(i - begin);
+          board_time = candidate_board_time;
+          ride_time = 0.0;
+        }
+      }
+    }
+  }
+  return round;
+}
+
+RaptorRouter::Journey RaptorRouter::ExtractJourney(
+    const QueryState& state, size_t round_count, StopIndex from,
+    StopIndex to) const {
+  const size_t stop_count = stops_.size();
+  Journey journey{state.round_times[round_count * stop_count + to], {}};
+  StopIndex stop = to;
+  for (size_t round = round_count; stop != from; --round) {
+    const Label& label = state.round_labels[round * stop_count + stop];
+    if (label.route == NO_ROUTE) {
+      continue;
+    }
+    const StopIndex board_stop =
+        route_stops_[route_offsets_[label.route] + label.board_position];
+    journey.legs.push_back({route_buses_[label.route], stops_[board_stop],
+                            label.alight_position - label.board_position,
+                            label.ride_time});
+    stop = board_stop;
+  }
+  std::reverse(journey.legs.begin(), journey.legs.end());
+  return journey;
+}
+}  // namespace router
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "domain.h"
+#include "transport_catalogue.h"
+
+namespace router {
+// Round-based (RAPTOR-like) router that scans the catalogue's bus routes
+// directly instead of searching a graph. Round k finds the best times
+// reachable with exactly k boardings, so the rounds double as answers to
+// "at most N transfers" queries. Every boarding costs the same wait time,
+// and ride times are summed from the boarding stop on, in the same order
+// the stop-pairs graph sums them, so totals match the graph engines.
+class RaptorRouter {
+ public:
+  using SegmentTime = std::function<double(const Stop* from, const Stop* to)>;
+
+  struct Leg {
+    catalogue::TransportCatalogue::BusPtr bus;
+    catalogue::TransportCatalogue::StopPtr board_stop;
+    size_t span_count;
+    double ride_time;
+  };
+
+  struct Journey {
+    double total_time;
+    std::vector<Leg> legs;
+  };
+
+  RaptorRouter(const catalogue::TransportCatalogue& db, double wait_time,
+               const SegmentTime& segment_time);
+
+  // Without max_transfers the rounds run until no stop improves.
+  std::optional<Journey> FindJourney(
+      catalogue::TransportCatalogue::StopPtr from,
+      catalogue::TransportCatalogue::StopPtr to,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+
+  // Journeys from one stop to many out of a single untargeted search.
+  std::vector<std::optional<Journey>> FindJourneys(
+      catalogue::TransportCatalogue::StopPtr from,
+      const std::vector<catalogue::TransportCatalogue::StopPtr>& to,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+
+  // The journeys of the rounds that improved the arrival at to: the
+  // fastest first, then ones with ever fewer legs.
+  std::vector<Journey> FindParetoJourneys(
+      catalogue::TransportCatalogue::StopPtr from,
+      catalogue::TransportCatalogue::StopPtr to,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+
+  // Earliest arrival at every stop reachable within max_time, in no
+  // particular order; the origin itself is included with zero time.
+  std::vector<std::pair<catalogue::TransportCatalogue::StopPtr, double>>
+  FindReachableStops(catalogue::TransportCatalogue::StopPtr from,
+                     double max_time) const;
+
+  // Routes scanned and stop labels set by the last query on the calling
+  // thread.
+  static size_t GetLastScannedRouteCount();
+  static size_t GetLastLabelCount();
+
+ private:
+  using StopIndex = uint32_t;
+  using RouteIndex = uint32_t;
+
+  static constexpr RouteIndex NO_ROUTE = static_cast<RouteIndex>(-1);
+
+  struct RouteVisit {
+    RouteIndex route;
+    uint32_t position;
+  };
+
+  // How a stop was reached in a round: by riding route from board_position
+  // to alight_position. NO_ROUTE means the previous round's label holds.
+  struct Label {
+    RouteIndex route;
+    uint32_t board_position;
+    uint32_t alight_position;
+    double ride_time;
+  };
+
+  struct QueryState;
+  static QueryState& GetQueryState();
+
+  // Runs rounds from source and returns how many were run. With a target,
+  // arrivals no better than the target's are pruned; arrivals later than
+  // time_limit always are.
+  size_t RunRounds(QueryState& state, StopIndex source,
+                   std::optional<StopIndex> target, size_t max_rounds,
+                   double time_limit) const;
+  Journey ExtractJourney(const QueryState& state, size_t round_count,
+                         StopIndex from, StopIndex to) const;
+
+  double wait_time_;
+  std::vector<catalogue::TransportCatalogue::StopPtr> stops_;
+  std::unordered_map<catalogue::TransportCatalogue::StopPtr, StopIndex>
+      stop_indices_;
+
+  // Route r visits route_stops_[route_offsets_[r] .. route_offsets_[r + 1]);
+  // segment_times_ is laid out alongside and holds the time from the
+  // previous stop (zero at the first one).
+  std::vector<catalogue::TransportCatalogue::BusPtr> route_buses_;
+  std::vector<size_t> route_offsets_;
+  std::vector<StopIndex> route_stops_;
+  std::vector<double> segment_times_;
+
+  // Every (route, position) visiting stop s, grouped by stop.
+  std::vector<size_t> stop_visit_offsets_;
+  std::vector<RouteVisit> stop_visits_;
+};
+}  // namespace router
@@ -1,13 +1,22 @@
 #include "request_handler.h"
 
+#include <limits>
+#include <string>
+#include <utility>
+#include <variant>
+
 #include "json.h"
 #include "json_builder.h"
 #include "transport_router.h"
 
 RequestHandler::RequestHandler(const catalogue::TransportCatalogue& db,
                                const renderer::MapRenderer& renderer,
-                               const router::TransportRouter& router)
-    : db_(db), renderer_(renderer), router_(router) {}
+                               RouterFuture router)
+    : db_(db), renderer_(renderer), router_(std::move(router)) {}
+
+const router::TransportRouter& RequestHandler::GetRouter() const {
+  return *router_.get();
+}
 
 std::optional<BusStat> RequestHandler::GetBusStat(
     const std::string_view& bus_name) const {
@@ -23,12 +32,54 @@ svg::Document RequestHandler::RenderMap() const {
   return renderer_.RenderMap();
 }
 
-json::Dict RequestHandler::FindRoute(std::string_view from, std::string_view to,
-                                     int request_id) {
+namespace {
+void AddRouteItemKeys(json::Builder& builder, const router::WaitItem& item) {
+  builder.Key("type").Value("Wait");
+  builder.Key("stop_name").Value(std::string(item.stop_name));
+  builder.Key("time").Value(item.time);
+}
+
+void AddRouteItemKeys(json::Builder& builder, const router::BusItem& item) {
+  builder.Key("type").Value("Bus");
+  builder.Key("bus").Value(std::string(item.bus_name));
+  builder.Key("span_count").Value(static_cast<int>(item.span_count));
+  builder.Key("time").Value(item.time);
+}
+
+// Adds the total_time and items keys to the dict being built, and the
+// settled_count of the search when the route came from one.
+void AddRouteKeys(json::Builder& builder, const router::RouteInfo& route_info) {
+  builder.Key("total_time").Value(route_info.total_time);
+  builder.Key("items").StartArray();
+  for (const router::RouteItem& item : route_info.items) {
+    builder.StartDict();
+    std::visit(
+        [&builder](const auto& typed_item) {
+          AddRouteItemKeys(builder, typed_item);
+        },
+        item);
+    builder.EndDict();
+  }
+  builder.EndArray();
+  if (route_info.settled_count) {
+    builder.Key("settled_count")
+        .Value(static_cast<int>(*route_info.settled_count));
+  }
+}
+
+// Footprints may not fit an int; larger ones are given as doubles.
+json::Node::Value MakeCountValue(size_t count) {
+  if (count <= static_cast<size_t>(std::numeric_limits<int>::max())) {
+    return static_cast<int>(count);
+  }
+  return static_cast<double>(count);
+}
+
+json::Dict MakeRouteResponse(const std::optional<router::RouteInfo>& route_info,
+                             int request_id) {
   json::Builder builder;
   builder.StartDict();
   builder.Key("request_id").Value(request_id);
-  std::optional<router::RouteInfo> route_info = router_.GetRouteInfo(from, to);
   if (!route_info) {
     return builder.Key("error_message")
         .Value("not found")
@@ -36,22 +87,149 @@ json::Dict RequestHandler::FindRoute(std::string_view from, std::string_view to,
         .Build()
         .AsMap();
   }
-  builder.Key("total_time").Value((*route_info).total_time);
-  builder.Key("items").StartArray();
-  for (const auto& item : (*route_info).items) {
+  AddRouteKeys(builder, *route_info);
+  builder.EndDict();
+  return builder.Build().AsMap();
+}
+}  // namespace
+
+// The best route is answered as without alternatives, the others follow
+// in an "alternatives" array.
+json::Dict RequestHandler::FindAlternativeRoutes(
+    std::string_view from, std::string_view to, int request_id,
+    size_t max_count, std::optional<size_t> max_transfers) {
+  std::vector<router::RouteInfo> route_infos =
+      GetRouter().GetAlternativeRouteInfos(from, to, max_count, max_transfers);
+  if (route_infos.empty()) {
+    return MakeRouteResponse(std::nullopt, request_id);
+  }
+  json::Builder builder;
+  builder.StartDict();
+  builder.Key("request_id").Value(request_id);
+  AddRouteKeys(builder, route_infos.front());
+  builder.Key("alternatives").StartArray();
+  for (size_t i = 1; i < route_infos.size(); ++i) {
     builder.StartDict();
-    for (const auto& [key, value] : item) {
-      builder.Key(key);
-      if (key == "time") {
-        builder.Value(std::stod(value));
-      } else if (key == "span_count") {
-        builder.Value(std::stoi(value));
+    AddRouteKeys(builder, route_infos[i]);
+    builder.EndDict();
+  }
+  builder.EndArray().EndDict();
+  return builder.Build().AsMap();
+}
+
+json::Dict RequestHandler::FindParetoRoutes(
+    std::string_view from, std::string_view to, int request_id,
+    std::optional<size_t> max_transfers) {
+  router::ParetoRouteInfos route_infos =
+      GetRouter().GetParetoRouteInfos(from, to, max_transfers);
+  if (route_infos.routes.empty()) {
+    return MakeRouteResponse(std::nullopt, request_id);
+  }
+  json::Builder builder;
+  builder.StartDict();
+  builder.Key("request_id").Value(request_id);
+  builder.Key("routes").StartArray();
+  for (const router::RouteInfo& route_info : route_infos.routes) {
+    builder.StartDict();
+    AddRouteKeys(builder, route_info);
+    builder.EndDict();
+  }
+  builder.EndArray();
+  builder.Key("label_count").Value(static_cast<int>(route_infos.label_count));
+  builder.EndDict();
+  return builder.Build().AsMap();
+}
+
+std::vector<json::Dict> RequestHandler::FindRoutes(
+    std::string_view from, const std::vector<std::string_view>& to,
+    const std::vector<int>& request_ids, std::optional<size_t> max_transfers) {
+  std::vector<std::optional<router::RouteInfo>> route_infos =
+      GetRouter().GetRouteInfos(from, to, max_transfers);
+  std::vector<json::Dict> responses;
+  responses.reserve(route_infos.size());
+  for (size_t i = 0; i < route_infos.size(); ++i) {
+    responses.push_back(MakeRouteResponse(route_infos[i], request_ids[i]));
+  }
+  return responses;
+}
+
+json::Dict RequestHandler::BuildTravelTimeMatrix(
+    const std::vector<std::string_view>& from,
+    const std::vector<std::string_view>& to, int request_id) {
+  json::Builder builder;
+  builder.StartDict();
+  builder.Key("request_id").Value(request_id);
+  builder.Key("times").StartArray();
+  for (const auto& row : GetRouter().GetTravelTimeMatrix(from, to)) {
+    builder.StartArray();
+    for (const auto& time : row) {
+      if (time) {
+        builder.Value(*time);
       } else {
-        builder.Value(value);
+        builder.Value(nullptr);
       }
     }
-    builder.EndDict();
+    builder.EndArray();
+  }
+  builder.EndArray().EndDict();
+  return builder.Build().AsMap();
+}
+
+json::Dict RequestHandler::FindReachableStops(std::string_view from,
+                                              double max_time,
+                                              int request_id) {
+  json::Builder builder;
+  builder.StartDict();
+  builder.Key("request_id").Value(request_id);
+  builder.Key("stops").StartArray();
+  for (const auto& stop : GetRouter().GetReachableStops(from, max_time)) {
+    builder.StartDict()
+        .Key("stop_name")
+        .Value(std::string(stop.stop_name))
+        .Key("time")
+        .Value(stop.time)
+        .EndDict();
   }
   builder.EndArray().EndDict();
   return builder.Build().AsMap();
+}
+
+json::Dict RequestHandler::GetRouterStats(int request_id) const {
+  const router::TransportRouter& router = GetRouter();
+  const caching::CacheStats cache_stats = router.GetRouteCacheStats();
+  json::Builder builder;
+  builder.StartDict();
+  builder.Key("request_id").Value(request_id);
+  builder.Key("route_cache")
+      .StartDict()
+      .Key("hits")
+      .Value(static_cast<int>(cache_stats.hits))
+      .Key("misses")
+      .Value(static_cast<int>(cache_stats.misses))
+      .Key("evictions")
+      .Value(static_cast<int>(cache_stats.evictions))
+      .EndDict();
+  if (const auto pruned_edge_count = router.GetPrunedEdgeCount()) {
+    builder.Key("pruned_edge_count").Value(MakeCountValue(*pruned_edge_count));
+  }
+  if (const auto hub_label_stats = router.GetHubLabelStats()) {
+    builder.Key("hub_labels")
+        .StartDict()
+        .Key("entry_count")
+        .Value(MakeCountValue(hub_label_stats->entry_count))
+        .Key("label_bytes")
+        .Value(MakeCountValue(hub_label_stats->label_bytes))
+        .Key("average_label_size")
+        .Value(hub_label_stats->average_label_size)
+        .EndDict();
+  }
+  if (const auto matrix_bytes = router.GetAllPairsMatrixBytes()) {
+    builder.Key("all_pairs")
+        .StartDict()
+        .Key("matrix_bytes")
+        .Value(MakeCountValue(*matrix_bytes))
+        .EndDict();
+  }
+  builder.EndDict();
+  return builder.Build().AsMap();
 }
\ No newline at end of file
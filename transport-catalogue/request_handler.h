@@ -1,7 +1,10 @@
 #pragma once
 
+#include <future>
+#include <memory>
 #include <optional>
 #include <string_view>
+#include <vector>
 
 #include "graph.h"
 #include "json.h"
@@ -12,9 +15,13 @@
 
 class RequestHandler {
  public:
+  // The router may still be being built; only the methods that route wait
+  // for it.
+  using RouterFuture =
+      std::shared_future<std::unique_ptr<const router::TransportRouter>>;
+
   RequestHandler(const catalogue::TransportCatalogue& db,
-                 const renderer::MapRenderer& renderer,
-                 const router::TransportRouter& router);
+                 const renderer::MapRenderer& renderer, RouterFuture router);
 
   std::optional<BusStat> GetBusStat(const std::string_view& bus_name) const;
 
@@ -22,10 +29,35 @@ class RequestHandler {
       std::string_view stop_name) const;
 
   svg::Document RenderMap() const;
-  json::Dict FindRoute(std::string_view from, std::string_view to, int request_id);
+  // Up to max_count routes, the best one first.
+  json::Dict FindAlternativeRoutes(
+      std::string_view from, std::string_view to, int request_id,
+      size_t max_count, std::optional<size_t> max_transfers = std::nullopt);
+  // The fastest route and those taking fewer buses in a "routes" array,
+  // with the search's label count.
+  json::Dict FindParetoRoutes(std::string_view from, std::string_view to,
+                              int request_id,
+                              std::optional<size_t> max_transfers);
+  // Routes from one stop to many, answered together; responses follow the
+  // order of to.
+  std::vector<json::Dict> FindRoutes(std::string_view from,
+                                     const std::vector<std::string_view>& to,
+                                     const std::vector<int>& request_ids,
+                                     std::optional<size_t> max_transfers);
+  json::Dict BuildTravelTimeMatrix(const std::vector<std::string_view>& from,
+                                   const std::vector<std::string_view>& to,
+                                   int request_id);
+  json::Dict FindReachableStops(std::string_view from, double max_time,
+                                int request_id);
+  // Counters of the router: route cache hits, misses and evictions so far,
+  // the edges parallel-edge pruning removed and the footprint of the hub
+  // labels or all-pairs matrices.
+  json::Dict GetRouterStats(int request_id) const;
 
  private:
+  const router::TransportRouter& GetRouter() const;
+
   const catalogue::TransportCatalogue& db_;
   const renderer::MapRenderer& renderer_;
-  const router::TransportRouter& router_;
+  RouterFuture router_;
 };
\ No newline at end of file
@@ -2,131 +2,682 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
+#include <ostream>
 #include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "aligned_allocator.h"
+#include "components.h"
 #include "graph.h"
+#include "mapped_file.h"
+#include "min_plus.h"
+#include "search_state.h"
+#include "thread_pool.h"
 
 namespace graph {
 
+// An edge whose weight the graph now holds differs from old_weight, or a
+// new edge when old_weight is empty.
 template <typename Weight>
-class Router {
-   private:
-    using Graph = DirectedWeightedGraph<Weight>;
+struct EdgeWeightChange {
+    EdgeId edge_id;
+    std::optional<Weight> old_weight;
+};
 
+template <typename Weight>
+class RouterEngine {
    public:
-    explicit Router(const Graph& graph);
-
     struct RouteInfo {
         Weight weight;
         std::vector<EdgeId> edges;
+        // Vertices settled by the search that found the route; 0 when the
+        // engine answered from what it precomputed.
+        size_t settled_count = 0;
     };
 
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
+    virtual ~RouterEngine() = default;
+
+    virtual std::optional<RouteInfo> BuildRoute(VertexId from,
+                                                VertexId to) const = 0;
+
+    // Weight of the best route, for engines that can tell it without
+    // unpacking the route's edges.
+    virtual std::optional<Weight> GetRouteWeight(VertexId from,
+                                                 VertexId to) const {
+        std::optional<RouteInfo> route = BuildRoute(from, to);
+        if (!route) {
+            return std::nullopt;
+        }
+        return route->weight;
+    }
+
+    // Called after edge weights of the graph changed or edges were added.
+    // Returns false when the engine cannot repair what it precomputed and
+    // has to be rebuilt.
+    virtual bool UpdateEdgeWeights(
+        const std::vector<EdgeWeightChange<Weight>>& /*changes*/) {
+        return false;
+    }
+};
+
+// Stores matrix weights as Integer counts of 1/Scale units.
+template <typename Integer, int64_t Scale>
+struct FixedPoint {};
+
+// Conversion between graph weights and the type Router keeps them in. The
+// largest representable value marks a missing route.
+template <typename Weight, typename Stored>
+struct MatrixWeightTraits {
+    using Value = Stored;
+    static constexpr int64_t SCALE = 0;
+
+    static constexpr Value Infinity() {
+        return std::numeric_limits<Value>::has_infinity
+                   ? std::numeric_limits<Value>::infinity()
+                   : std::numeric_limits<Value>::max();
+    }
+    static Value ToStored(Weight weight) {
+        return static_cast<Value>(weight);
+    }
+    static Weight FromStored(Value value) {
+        return static_cast<Weight>(value);
+    }
+};
+
+// A weight that does not fit below the infinity mark is stored as a
+// missing route instead of wrapping around, and so is a route whose weight
+// would overflow Integer: MinPlusRelaxRow never accepts such a sum.
+template <typename Weight, typename Integer, int64_t Scale>
+struct MatrixWeightTraits<Weight, FixedPoint<Integer, Scale>> {
+    using Value = Integer;
+    static constexpr int64_t SCALE = Scale;
+
+    static constexpr Value Infinity() {
+        return std::numeric_limits<Value>::max();
+    }
+    static Value ToStored(Weight weight) {
+        const Weight scaled = std::round(weight * Scale);
+        if (!(scaled < static_cast<Weight>(Infinity()))) {
+            return Infinity();
+        }
+        return static_cast<Value>(scaled);
+    }
+    static Weight FromStored(Value value) {
+        return static_cast<Weight>(value) / Scale;
+    }
+};
 
+// All-pairs shortest paths precomputed with Floyd-Warshall. No route
+// leaves a weak component, so the matrices are block diagonal and only the
+// blocks are kept: one square block per component, with rows and columns
+// in the order of the component's vertices. Their sizes add up to the sum
+// of the squared component sizes rather than the squared vertex count.
+// Weights and last edges live in two flat arrays of such blocks whose rows
+// start on cache line boundaries. StoredWeight may be narrower than Weight
+// (float or FixedPoint) to shrink them.
+template <typename Weight, typename StoredWeight = Weight>
+class Router : public RouterEngine<Weight> {
    private:
-    struct RouteInternalData {
-        Weight weight;
-        std::optional<EdgeId> prev_edge;
+    using Graph = DirectedWeightedGraph<Weight>;
+    using Traits = MatrixWeightTraits<Weight, StoredWeight>;
+    using MatrixWeight = typename Traits::Value;
+    using MatrixEdgeId = uint32_t;
+
+   public:
+    using typename RouterEngine<Weight>::RouteInfo;
+
+    // With a thread pool the all-pairs precompute is split into tiles that
+    // run in parallel; the resulting routes are the same as without one.
+    explicit Router(const Graph& graph,
+                    parallel::ThreadPool* thread_pool = nullptr);
+
+    std::optional<RouteInfo> BuildRoute(VertexId from,
+                                        VertexId to) const override;
+    std::optional<Weight> GetRouteWeight(VertexId from,
+                                         VertexId to) const override;
+
+    // Rows whose routes may change are recomputed with Dijkstra; all other
+    // rows stay as they are. Vertices added to the graph, new edges joining
+    // two components, or matrices mapped from a file need a rebuild.
+    bool UpdateEdgeWeights(
+        const std::vector<EdgeWeightChange<Weight>>& changes) override;
+
+    // Bytes of both matrices, row padding included, to weigh against
+    // other engines' footprints.
+    size_t GetMatrixBytes() const {
+        return layout_.cell_count *
+               (sizeof(MatrixWeight) + sizeof(MatrixEdgeId));
+    }
+
+    // Writes both matrices as they are kept in memory, after a header with
+    // a hash of the graph they were computed for.
+    void Save(std::ostream& output) const;
+
+    // A router answering straight from the pages of a file written by Save,
+    // with nothing copied or parsed but the header. Returns nullptr when the
+    // file was saved for another graph, weight type or format version.
+    static std::unique_ptr<Router> Load(
+        const Graph& graph, std::unique_ptr<const memory::MappedFile> file);
+
+   private:
+    // Cells of a block's row local_index start at first_cell + local_index
+    // * row_stride; its vertices are vertices[first_vertex ..
+    // first_vertex + vertex_count) of the layout.
+    struct Block {
+        size_t first_vertex;
+        size_t vertex_count;
+        size_t row_stride;
+        size_t first_cell;
+    };
+
+    // A function of the graph alone, so a saved file and the graph it is
+    // loaded for agree on it.
+    struct Layout {
+        std::vector<Block> blocks;
+        // Grouped by block, in increasing order within each.
+        std::vector<VertexId> vertices;
+        std::vector<uint32_t> vertex_blocks;
+        std::vector<uint32_t> local_indices;
+        size_t cell_count = 0;
+    };
+
+    // The matrices follow the header at cache line aligned offsets, so a
+    // page-aligned mapping keeps every row aligned too.
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byte_order;
+        uint32_t weight_size;
+        uint32_t is_floating_weight;
+        int64_t weight_scale;
+        uint64_t graph_hash;
+        uint64_t vertex_count;
+        uint64_t cell_count;
     };
-    using RoutesInternalData =
-        std::vector<std::vector<std::optional<RouteInternalData>>>;
+    static_assert(sizeof(FileHeader) <= memory::CACHE_LINE_SIZE);
+
+    Router(const Graph& graph, Layout layout,
+           std::unique_ptr<const memory::MappedFile> file);
+
+    static Layout MakeLayout(const Graph& graph);
+    static FileHeader MakeFileHeader(const Graph& graph, const Layout& layout);
+
+    // FNV-1a over the vertex count and every edge, weights included.
+    static uint64_t HashGraph(const Graph& graph) {
+        uint64_t hash = 14695981039346656037ull;
+        const auto add = [&hash](const void* data, size_t size) {
+            const auto* bytes = static_cast<const unsigned char*>(data);
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            }
+        };
+        const uint64_t vertex_count = graph.GetVertexCount();
+        add(&vertex_count, sizeof(vertex_count));
+        for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+            const Edge<Weight>& edge = graph.GetEdge(edge_id);
+            add(&edge.from, sizeof(edge.from));
+            add(&edge.to, sizeof(edge.to));
+            add(&edge.weight, sizeof(edge.weight));
+        }
+        return hash;
+    }
 
     void InitializeRoutesInternalData(const Graph& graph) {
         const size_t vertex_count = graph.GetVertexCount();
         for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-            routes_internal_data_[vertex][vertex] =
-                RouteInternalData{ZERO_WEIGHT, std::nullopt};
-            for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-                const auto& edge = graph.GetEdge(edge_id);
-                if (edge.weight < ZERO_WEIGHT) {
+            MatrixWeight* weights = GetWeightsRow(vertex);
+            MatrixEdgeId* prev_edges = GetPrevEdgesRow(vertex);
+            weights[layout_.local_indices[vertex]] =
+                Traits::ToStored(ZERO_WEIGHT);
+            graph.ForEachOutgoingArc(vertex, [&](const Arc<Weight>& arc) {
+                if (arc.weight < ZERO_WEIGHT) {
                     throw std::domain_error(
                         "Edges' weights should be non-negative");
                 }
-                auto& route_internal_data =
-                    routes_internal_data_[vertex][edge.to];
-                if (!route_internal_data ||
-                    route_internal_data->weight > edge.weight) {
-                    route_internal_data =
-                        RouteInternalData{edge.weight, edge_id};
+                const MatrixWeight weight = Traits::ToStored(arc.weight);
+                const uint32_t column = layout_.local_indices[arc.to];
+                if (weights[column] > weight) {
+                    weights[column] = weight;
+                    prev_edges[column] = static_cast<MatrixEdgeId>(arc.edge_id);
                 }
+            });
+        }
+    }
+
+    // Rows, columns and the vertex relaxed through are local to the block.
+    void RelaxTileThroughVertex(const Block& block, uint32_t vertex_through,
+                                uint32_t row_begin, uint32_t row_end,
+                                uint32_t column_begin, uint32_t column_end) {
+        const MatrixWeight* through_weights =
+            GetBlockWeightsRow(block, vertex_through);
+        const MatrixEdgeId* through_prev_edges =
+            GetBlockPrevEdgesRow(block, vertex_through);
+        for (uint32_t vertex_from = row_begin; vertex_from < row_end;
+             ++vertex_from) {
+            MatrixWeight* weights = GetBlockWeightsRow(block, vertex_from);
+            MatrixEdgeId* prev_edges = GetBlockPrevEdgesRow(block, vertex_from);
+            const MatrixWeight weight_from = weights[vertex_through];
+            if (weight_from == INFINITE_WEIGHT) {
+                continue;
             }
+            MinPlusRelaxRow(weight_from, prev_edges[vertex_through],
+                            through_weights + column_begin,
+                            through_prev_edges + column_begin,
+                            weights + column_begin, prev_edges + column_begin,
+                            column_end - column_begin, INFINITE_WEIGHT,
+                            NO_MATRIX_EDGE);
         }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                    const RouteInternalData& route_from,
-                    const RouteInternalData& route_to) {
-        auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-        const Weight candidate_weight = route_from.weight + route_to.weight;
-        if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-            route_relaxing = {candidate_weight, route_to.prev_edge
-                                                    ? route_to.prev_edge
-                                                    : route_from.prev_edge};
+    // Relaxing through a vertex never changes its own row and column, as
+    // its route to itself has zero weight. The tiles of one step are
+    // therefore independent and may run in any order or concurrently with
+    // bit-identical results. Steps themselves stay sequential: blocking
+    // several steps together would reorder the floating-point additions.
+    // Small blocks are relaxed on the calling thread, as handing out their
+    // one tile would cost more than relaxing it.
+    void RelaxRoutesInternalDataThroughVertex(
+        const Block& block, uint32_t vertex_through,
+        parallel::ThreadPool* thread_pool) {
+        const size_t vertex_count = block.vertex_count;
+        const size_t row_tiles = (vertex_count + ROW_TILE - 1) / ROW_TILE;
+        const size_t column_tiles =
+            (vertex_count + COLUMN_TILE - 1) / COLUMN_TILE;
+        const auto relax_tile = [&](size_t tile) {
+            const size_t row_begin = tile / column_tiles * ROW_TILE;
+            const size_t column_begin = tile % column_tiles * COLUMN_TILE;
+            RelaxTileThroughVertex(
+                block, vertex_through, row_begin,
+                std::min(row_begin + ROW_TILE, vertex_count), column_begin,
+                std::min(column_begin + COLUMN_TILE, vertex_count));
+        };
+        if (thread_pool && row_tiles * column_tiles > 1) {
+            thread_pool->ParallelFor(row_tiles * column_tiles, relax_tile);
+        } else {
+            for (size_t tile = 0; tile < row_tiles * column_tiles; ++tile) {
+                relax_tile(tile);
+            }
         }
     }
 
-    void RelaxRoutesInternalDataThroughVertex(size_t vertex_count,
-                                              VertexId vertex_through) {
-        for (VertexId vertex_from = 0; vertex_from < vertex_count;
-             ++vertex_from) {
-            if (const auto& route_from =
-                    routes_internal_data_[vertex_from][vertex_through]) {
-                for (VertexId vertex_to = 0; vertex_to < vertex_count;
-                     ++vertex_to) {
-                    if (const auto& route_to =
-                            routes_internal_data_[vertex_through][vertex_to]) {
-                        RelaxRoute(vertex_from, vertex_to, *route_from,
-                                   *route_to);
+    // A longer edge only affects rows whose route tree goes through it. A
+    // shorter or new edge affects rows where it shortcuts the route to its
+    // head; when it does not, every route of the row stays optimal. Edges
+    // of other components affect neither.
+    bool IsRowAffected(VertexId vertex_from,
+                       const std::vector<EdgeWeightChange<Weight>>& changes)
+        const {
+        const MatrixWeight* weights = GetWeightsRow(vertex_from);
+        const MatrixEdgeId* prev_edges = GetPrevEdgesRow(vertex_from);
+        for (const auto& change : changes) {
+            const auto& edge = graph_.GetEdge(change.edge_id);
+            if (layout_.vertex_blocks[edge.from] !=
+                layout_.vertex_blocks[vertex_from]) {
+                continue;
+            }
+            const uint32_t from = layout_.local_indices[edge.from];
+            const uint32_t to = layout_.local_indices[edge.to];
+            if (prev_edges[to] == change.edge_id) {
+                return true;
+            }
+            const bool is_shorter =
+                !change.old_weight || edge.weight < *change.old_weight;
+            const MatrixWeight edge_weight = Traits::ToStored(edge.weight);
+            if (is_shorter && weights[from] != INFINITE_WEIGHT &&
+                edge_weight < INFINITE_WEIGHT - weights[from] &&
+                weights[from] + edge_weight < weights[to]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void RecomputeRow(VertexId vertex_from) {
+        static thread_local SearchState<Weight> state;
+        state.Prepare(vertex_count_);
+        state.Reach(vertex_from, ZERO_WEIGHT, NO_EDGE);
+        state.Push(ZERO_WEIGHT, ZERO_WEIGHT, vertex_from);
+        while (!state.queue.empty()) {
+            const auto item = state.Pop();
+            if (state.IsStale(item)) {
+                continue;
+            }
+            graph_.ForEachOutgoingArc(
+                item.vertex, [&](const Arc<Weight>& arc) {
+                    const Weight candidate_weight = item.weight + arc.weight;
+                    if (!state.IsReached(arc.to) ||
+                        candidate_weight < state.weights[arc.to]) {
+                        state.Reach(arc.to, candidate_weight, arc.edge_id);
+                        state.Push(candidate_weight, candidate_weight,
+                                   arc.to);
                     }
-                }
+                });
+        }
+
+        // The search never leaves the block's component.
+        const Block& block = GetBlock(vertex_from);
+        MatrixWeight* weights = GetWeightsRow(vertex_from);
+        MatrixEdgeId* prev_edges = GetPrevEdgesRow(vertex_from);
+        for (uint32_t column = 0; column < block.vertex_count; ++column) {
+            const VertexId vertex =
+                layout_.vertices[block.first_vertex + column];
+            weights[column] = state.IsReached(vertex)
+                                  ? Traits::ToStored(state.weights[vertex])
+                                  : INFINITE_WEIGHT;
+            if (weights[column] == INFINITE_WEIGHT) {
+                prev_edges[column] = NO_MATRIX_EDGE;
+                continue;
             }
+            prev_edges[column] =
+                state.prev_edges[vertex] == NO_EDGE
+                    ? NO_MATRIX_EDGE
+                    : static_cast<MatrixEdgeId>(state.prev_edges[vertex]);
         }
     }
 
+    const Block& GetBlock(VertexId vertex) const {
+        return layout_.blocks[layout_.vertex_blocks[vertex]];
+    }
+    MatrixWeight* GetBlockWeightsRow(const Block& block, uint32_t row) {
+        return weights_.data() + block.first_cell + row * block.row_stride;
+    }
+    MatrixEdgeId* GetBlockPrevEdgesRow(const Block& block, uint32_t row) {
+        return prev_edges_.data() + block.first_cell + row * block.row_stride;
+    }
+
+    // Rows of a vertex are indexed by the local index of the other end.
+    MatrixWeight* GetWeightsRow(VertexId vertex) {
+        return GetBlockWeightsRow(GetBlock(vertex),
+                                  layout_.local_indices[vertex]);
+    }
+    const MatrixWeight* GetWeightsRow(VertexId vertex) const {
+        const Block& block = GetBlock(vertex);
+        return weights_data_ + block.first_cell +
+               layout_.local_indices[vertex] * block.row_stride;
+    }
+    MatrixEdgeId* GetPrevEdgesRow(VertexId vertex) {
+        return GetBlockPrevEdgesRow(GetBlock(vertex),
+                                    layout_.local_indices[vertex]);
+    }
+    const MatrixEdgeId* GetPrevEdgesRow(VertexId vertex) const {
+        const Block& block = GetBlock(vertex);
+        return prev_edges_data_ + block.first_cell +
+               layout_.local_indices[vertex] * block.row_stride;
+    }
+
+    // Rows are padded so that every row of both matrices starts on a cache
+    // line boundary.
+    static size_t GetRowStride(size_t vertex_count) {
+        constexpr size_t alignment =
+            memory::CACHE_LINE_SIZE /
+            std::min(sizeof(MatrixWeight), sizeof(MatrixEdgeId));
+        return (vertex_count + alignment - 1) / alignment * alignment;
+    }
+
+    static constexpr size_t ROW_TILE = 64;
+    static constexpr size_t COLUMN_TILE = 512;
     static constexpr Weight ZERO_WEIGHT{};
+    static constexpr MatrixWeight INFINITE_WEIGHT = Traits::Infinity();
+    static constexpr MatrixEdgeId NO_MATRIX_EDGE =
+        std::numeric_limits<MatrixEdgeId>::max();
+    static constexpr char FILE_MAGIC[8] = {'T', 'C', 'R', 'O',
+                                           'U', 'T', 'E', 'R'};
+    static constexpr uint32_t FILE_VERSION = 2;
+    static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
     const Graph& graph_;
-    RoutesInternalData routes_internal_data_;
+    parallel::ThreadPool* thread_pool_;
+    size_t vertex_count_;
+    Layout layout_;
+    std::vector<MatrixWeight, memory::AlignedAllocator<MatrixWeight>> weights_;
+    std::vector<MatrixEdgeId, memory::AlignedAllocator<MatrixEdgeId>>
+        prev_edges_;
+    // Queries read the matrices through these: the vectors above, or the
+    // pages of mapped_file_, in which case the vectors stay empty.
+    const MatrixWeight* weights_data_ = nullptr;
+    const MatrixEdgeId* prev_edges_data_ = nullptr;
+    std::unique_ptr<const memory::MappedFile> mapped_file_;
 };
 
-template <typename Weight>
-Router<Weight>::Router(const Graph& graph)
+template <typename Weight, typename StoredWeight>
+Router<Weight, StoredWeight>::Router(const Graph& graph,
+                                     parallel::ThreadPool* thread_pool)
     : graph_(graph),
-      routes_internal_data_(graph.GetVertexCount(),
-                            std::vector<std::optional<RouteInternalData>>(
-                                graph.GetVertexCount())) {
+      thread_pool_(thread_pool),
+      vertex_count_(graph.GetVertexCount()),
+      layout_(MakeLayout(graph)) {
+    if (graph.GetEdgeCount() >= NO_MATRIX_EDGE) {
+        throw std::length_error("too many edges for the route matrix");
+    }
+    weights_.assign(layout_.cell_count, INFINITE_WEIGHT);
+    prev_edges_.assign(layout_.cell_count, NO_MATRIX_EDGE);
+    weights_data_ = weights_.data();
+    prev_edges_data_ = prev_edges_.data();
     InitializeRoutesInternalData(graph);
 
+    // Vertices of other components never shorten a route, so relaxing
+    // through the block's own vertices in increasing order adds up the
+    // same weights as relaxing through all of them would.
+    for (const Block& block : layout_.blocks) {
+        for (uint32_t vertex_through = 0; vertex_through < block.vertex_count;
+             ++vertex_through) {
+            RelaxRoutesInternalDataThroughVertex(block, vertex_through,
+                                                 thread_pool);
+        }
+    }
+}
+
+template <typename Weight, typename StoredWeight>
+Router<Weight, StoredWeight>::Router(
+    const Graph& graph, Layout layout,
+    std::unique_ptr<const memory::MappedFile> file)
+    : graph_(graph),
+      thread_pool_(nullptr),
+      vertex_count_(graph.GetVertexCount()),
+      layout_(std::move(layout)),
+      mapped_file_(std::move(file)) {
+    const std::byte* weights_begin =
+        mapped_file_->GetData() + memory::CACHE_LINE_SIZE;
+    weights_data_ = reinterpret_cast<const MatrixWeight*>(weights_begin);
+    prev_edges_data_ = reinterpret_cast<const MatrixEdgeId*>(
+        weights_begin + layout_.cell_count * sizeof(MatrixWeight));
+}
+
+template <typename Weight, typename StoredWeight>
+typename Router<Weight, StoredWeight>::Layout
+Router<Weight, StoredWeight>::MakeLayout(const Graph& graph) {
+    const GraphComponents components(graph);
     const size_t vertex_count = graph.GetVertexCount();
-    for (VertexId vertex_through = 0; vertex_through < vertex_count;
-         ++vertex_through) {
-        RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
+    Layout layout;
+    layout.blocks.resize(components.GetWeakComponentCount(),
+                         Block{0, 0, 0, 0});
+    layout.vertex_blocks.resize(vertex_count);
+    layout.local_indices.resize(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        const uint32_t block = components.GetWeakComponent(vertex);
+        layout.vertex_blocks[vertex] = block;
+        layout.local_indices[vertex] = layout.blocks[block].vertex_count++;
+    }
+    size_t first_vertex = 0;
+    for (Block& block : layout.blocks) {
+        block.first_vertex = first_vertex;
+        block.row_stride = GetRowStride(block.vertex_count);
+        block.first_cell = layout.cell_count;
+        first_vertex += block.vertex_count;
+        layout.cell_count += block.vertex_count * block.row_stride;
+    }
+    layout.vertices.resize(vertex_count);
+    for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        const Block& block = layout.blocks[layout.vertex_blocks[vertex]];
+        layout.vertices[block.first_vertex + layout.local_indices[vertex]] =
+            vertex;
     }
+    return layout;
 }
 
-template <typename Weight>
-std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(
-    VertexId from, VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_.at(from).at(to);
-    if (!route_internal_data) {
+template <typename Weight, typename StoredWeight>
+typename Router<Weight, StoredWeight>::FileHeader
+Router<Weight, StoredWeight>::MakeFileHeader(const Graph& graph,
+                                             const Layout& layout) {
+    FileHeader header{};
+    std::memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+    header.version = FILE_VERSION;
+    header.byte_order = BYTE_ORDER_MARK;
+    header.weight_size = sizeof(MatrixWeight);
+    header.is_floating_weight = std::is_floating_point_v<MatrixWeight>;
+    header.weight_scale = Traits::SCALE;
+    header.graph_hash = HashGraph(graph);
+    header.vertex_count = graph.GetVertexCount();
+    header.cell_count = layout.cell_count;
+    return header;
+}
+
+template <typename Weight, typename StoredWeight>
+void Router<Weight, StoredWeight>::Save(std::ostream& output) const {
+    char header_bytes[memory::CACHE_LINE_SIZE] = {};
+    const FileHeader header = MakeFileHeader(graph_, layout_);
+    std::memcpy(header_bytes, &header, sizeof(header));
+    output.write(header_bytes, sizeof(header_bytes));
+    const size_t cell_count = layout_.cell_count;
+    output.write(reinterpret_cast<const char*>(weights_data_),
+                 cell_count * sizeof(MatrixWeight));
+    output.write(reinterpret_cast<const char*>(prev_edges_data_),
+                 cell_count * sizeof(MatrixEdgeId));
+}
+
+template <typename Weight, typename StoredWeight>
+std::unique_ptr<Router<Weight, StoredWeight>>
+Router<Weight, StoredWeight>::Load(
+    const Graph& graph, std::unique_ptr<const memory::MappedFile> file) {
+    if (file->GetSize() < memory::CACHE_LINE_SIZE) {
+        return nullptr;
+    }
+    FileHeader header;
+    std::memcpy(&header, file->GetData(), sizeof(header));
+    Layout layout = MakeLayout(graph);
+    const FileHeader expected_header = MakeFileHeader(graph, layout);
+    if (std::memcmp(&header, &expected_header, sizeof(header)) != 0 ||
+        file->GetSize() != memory::CACHE_LINE_SIZE +
+                               layout.cell_count * (sizeof(MatrixWeight) +
+                                                    sizeof(MatrixEdgeId))) {
+        return nullptr;
+    }
+    return std::unique_ptr<Router>(
+        new Router(graph, std::move(layout), std::move(file)));
+}
+
+template <typename Weight, typename StoredWeight>
+std::optional<typename Router<Weight, StoredWeight>::RouteInfo>
+Router<Weight, StoredWeight>::BuildRoute(VertexId from, VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+    if (layout_.vertex_blocks[from] != layout_.vertex_blocks[to]) {
+        return std::nullopt;
+    }
+    const MatrixWeight* weights = GetWeightsRow(from);
+    const MatrixEdgeId* prev_edges = GetPrevEdgesRow(from);
+    const uint32_t to_column = layout_.local_indices[to];
+    if (weights[to_column] == INFINITE_WEIGHT) {
         return std::nullopt;
     }
-    const Weight weight = route_internal_data->weight;
+    Weight weight = Traits::FromStored(weights[to_column]);
     std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]
-                       ->prev_edge) {
-        edges.push_back(*edge_id);
+    for (MatrixEdgeId edge_id = prev_edges[to_column];
+         edge_id != NO_MATRIX_EDGE;
+         edge_id = prev_edges[layout_.local_indices[graph_.GetEdge(edge_id)
+                                                        .from]]) {
+        edges.push_back(edge_id);
     }
     std::reverse(edges.begin(), edges.end());
+    // A narrower stored weight is rounded; the route's edges give it
+    // exactly, matching the times of its items.
+    if constexpr (!std::is_same_v<MatrixWeight, Weight>) {
+        weight = ZERO_WEIGHT;
+        for (const EdgeId edge_id : edges) {
+            weight += graph_.GetEdge(edge_id).weight;
+        }
+    }
 
     return RouteInfo{weight, std::move(edges)};
 }
 
-}  // namespace graph
\ No newline at end of file
+template <typename Weight, typename StoredWeight>
+bool Router<Weight, StoredWeight>::UpdateEdgeWeights(
+    const std::vector<EdgeWeightChange<Weight>>& changes) {
+    if (mapped_file_ || graph_.GetVertexCount() != vertex_count_ ||
+        graph_.GetEdgeCount() >= NO_MATRIX_EDGE) {
+        return false;
+    }
+    for (const auto& change : changes) {
+        const Edge<Weight>& edge = graph_.GetEdge(change.edge_id);
+        if (edge.weight < ZERO_WEIGHT) {
+            throw std::domain_error("Edges' weights should be non-negative");
+        }
+        if (layout_.vertex_blocks[edge.from] !=
+            layout_.vertex_blocks[edge.to]) {
+            return false;
+        }
+    }
+
+    std::vector<char> is_affected(vertex_count_, false);
+    const auto check_row = [&](size_t vertex) {
+        is_affected[vertex] = IsRowAffected(vertex, changes);
+    };
+    std::vector<VertexId> affected_rows;
+    if (thread_pool_) {
+        thread_pool_->ParallelFor(vertex_count_, check_row);
+    } else {
+        for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+            check_row(vertex);
+        }
+    }
+    for (VertexId vertex = 0; vertex < vertex_count_; ++vertex) {
+        if (is_affected[vertex]) {
+            affected_rows.push_back(vertex);
+        }
+    }
+
+    const auto recompute_row = [&](size_t index) {
+        RecomputeRow(affected_rows[index]);
+    };
+    if (thread_pool_) {
+        thread_pool_->ParallelFor(affected_rows.size(), recompute_row);
+    } else {
+        for (size_t index = 0; index < affected_rows.size(); ++index) {
+            recompute_row(index);
+        }
+    }
+    return true;
+}
+
+template <typename Weight, typename StoredWeight>
+std::optional<Weight> Router<Weight, StoredWeight>::GetRouteWeight(
+    VertexId from, VertexId to) const {
+    const size_t vertex_count = graph_.GetVertexCount();
+    if (from >= vertex_count || to >= vertex_count) {
+        throw std::out_of_range("vertex id is out of range");
+    }
+    if (layout_.vertex_blocks[from] != layout_.vertex_blocks[to]) {
+        return std::nullopt;
+    }
+    const MatrixWeight weight =
+        GetWeightsRow(from)[layout_.local_indices[to]];
+    if (weight == INFINITE_WEIGHT) {
+        return std::nullopt;
+    }
+    return Traits::FromStored(weight);
+}
+
+}  // namespace graph
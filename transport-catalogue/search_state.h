@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "graph.h"
+
+namespace graph {
+
+inline constexpr EdgeId NO_EDGE = static_cast<EdgeId>(-1);
+
+// Scratch buffers of a single-source search, meant to be reused across
+// queries. A vertex's weight and prev_edge are valid only while its stamp
+// equals the current search stamp, so nothing is cleared between queries.
+template <typename Weight>
+struct SearchState {
+    struct QueueItem {
+        Weight key;
+        Weight weight;
+        VertexId vertex;
+
+        bool operator>(const QueueItem& other) const {
+            return key > other.key;
+        }
+    };
+
+    std::vector<Weight> weights;
+    std::vector<EdgeId> prev_edges;
+    std::vector<uint32_t> stamps;
+    std::vector<QueueItem> queue;
+    uint32_t stamp = 0;
+    size_t settled_count = 0;
+
+    void Prepare(size_t vertex_count) {
+        if (stamps.size() < vertex_count) {
+            weights.resize(vertex_count);
+            prev_edges.resize(vertex_count);
+            stamps.resize(vertex_count, 0);
+        }
+        if (++stamp == 0) {
+            std::fill(stamps.begin(), stamps.end(), 0);
+            stamp = 1;
+        }
+        queue.clear();
+        settled_count = 0;
+    }
+
+    bool IsReached(VertexId vertex) const {
+        return stamps[vertex] == stamp;
+    }
+
+    void Reach(VertexId vertex, Weight weight, EdgeId prev_edge) {
+        stamps[vertex] = stamp;
+        weights[vertex] = weight;
+        prev_edges[vertex] = prev_edge;
+    }
+
+    void Push(Weight key, Weight weight, VertexId vertex) {
+        queue.push_back({key, weight, vertex});
+        std::push_heap(queue.begin(), queue.end(), std::greater<QueueItem>());
+    }
+
+    QueueItem Pop() {
+        std::pop_heap(queue.begin(), queue.end(), std::greater<QueueItem>());
+        const QueueItem item = queue.back();
+        queue.pop_back();
+        return item;
+    }
+
+    // An item is stale when its vertex was reached again with a smaller
+    // weight after the item had been queued.
+    bool IsStale(const QueueItem& item) const {
+        return item.weight > weights[item.vertex];
+    }
+};
+
+}  // namespace graph
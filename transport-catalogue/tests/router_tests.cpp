@@ -0,0 +1,869 @@
+// Checks of the routing engines against plain reference searches on small
+// random catalogues and graphs, and of internals the JSON requests cannot
+// reach. Built from the transport-catalogue directory together with every
+// source but main.cpp:
+//
+//   g++ -std=c++17 -O2 -pthread -I. -o router_tests tests/router_tests.cpp
+//       $(ls *.cpp | grep -v '^main.cpp$')
+//
+// Exits with a non-zero status when a check fails.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "dijkstra_router.h"
+#include "graph.h"
+#include "mapped_file.h"
+#include "min_plus.h"
+#include "router.h"
+#include "thread_pool.h"
+#include "transport_catalogue.h"
+#include "transport_router.h"
+
+namespace {
+
+int failure_count = 0;
+
+void Check(bool condition, const std::string& what) {
+    if (!condition) {
+        ++failure_count;
+        std::cerr << "FAILED: " << what << std::endl;
+    }
+}
+
+constexpr uint32_t NO_EDGE = std::numeric_limits<uint32_t>::max();
+
+template <typename Weight>
+struct MinPlusRow {
+    Weight weight_from;
+    uint32_t prev_edge_from;
+    std::vector<Weight> through_weights;
+    std::vector<uint32_t> through_prev_edges;
+    std::vector<Weight> weights;
+    std::vector<uint32_t> prev_edges;
+};
+
+// Small whole weights make exact ties between a candidate and the current
+// weight frequent, so the kernels must agree on keeping the old edge.
+template <typename Weight>
+MinPlusRow<Weight> MakeRandomRow(std::mt19937& random, size_t count) {
+    constexpr Weight INFINITE_WEIGHT =
+        std::numeric_limits<Weight>::infinity();
+    std::uniform_int_distribution<int> weight_dist(0, 20);
+    std::uniform_int_distribution<uint32_t> edge_dist(0, 1000);
+    std::bernoulli_distribution is_missing(0.2);
+    const auto random_weight = [&] {
+        return is_missing(random) ? INFINITE_WEIGHT
+                                  : static_cast<Weight>(weight_dist(random));
+    };
+    const auto random_edge = [&] {
+        return is_missing(random) ? NO_EDGE : edge_dist(random);
+    };
+
+    MinPlusRow<Weight> row;
+    row.weight_from = static_cast<Weight>(weight_dist(random));
+    row.prev_edge_from = edge_dist(random);
+    for (size_t j = 0; j < count; ++j) {
+        row.through_weights.push_back(random_weight());
+        row.through_prev_edges.push_back(random_edge());
+        row.weights.push_back(2 * random_weight());
+        row.prev_edges.push_back(random_edge());
+    }
+    return row;
+}
+
+template <typename Weight>
+void RelaxScalar(MinPlusRow<Weight>& row) {
+    graph::MinPlusRelaxRowScalar(
+        row.weight_from, row.prev_edge_from, row.through_weights.data(),
+        row.through_prev_edges.data(), row.weights.data(),
+        row.prev_edges.data(), row.weights.size(),
+        std::numeric_limits<Weight>::infinity(), NO_EDGE);
+}
+
+template <typename Weight>
+void RelaxDispatched(MinPlusRow<Weight>& row) {
+    graph::MinPlusRelaxRow(
+        row.weight_from, row.prev_edge_from, row.through_weights.data(),
+        row.through_prev_edges.data(), row.weights.data(),
+        row.prev_edges.data(), row.weights.size(),
+        std::numeric_limits<Weight>::infinity(), NO_EDGE);
+}
+
+template <typename Weight>
+void TestScalarMinPlusKernel(const std::string& type_name) {
+    constexpr Weight INF = std::numeric_limits<Weight>::infinity();
+    MinPlusRow<Weight> row{2,
+                           7,
+                           {1, INF, 3, 0, 1},
+                           {NO_EDGE, 4, 5, 6, 8},
+                           {5, 1, 5, INF, 3},
+                           {1, 2, 3, NO_EDGE, 9}};
+    RelaxScalar(row);
+    // Shorter through the vertex, no route through it, a tie, a new route
+    // and a tie again, whose edge must stay.
+    Check(row.weights == std::vector<Weight>{3, 1, 5, 2, 3},
+          "scalar min-plus weights, " + type_name);
+    Check(row.prev_edges == std::vector<uint32_t>{7, 2, 3, 6, 9},
+          "scalar min-plus edges, " + type_name);
+}
+
+template <typename Weight>
+void TestVectorMinPlusKernel(const std::string& type_name) {
+    std::mt19937 random(42);
+    // Lengths around the 4 and 8 lane widths leave scalar tails of every
+    // size.
+    for (size_t count = 0; count <= 40; ++count) {
+        for (int trial = 0; trial < 50; ++trial) {
+            MinPlusRow<Weight> scalar_row =
+                MakeRandomRow<Weight>(random, count);
+            MinPlusRow<Weight> vector_row = scalar_row;
+            RelaxScalar(scalar_row);
+            RelaxDispatched(vector_row);
+            const std::string what = "vector min-plus kernel, " + type_name +
+                                     ", " + std::to_string(count) +
+                                     " columns";
+            Check(scalar_row.weights == vector_row.weights,
+                  what + ", weights");
+            Check(scalar_row.prev_edges == vector_row.prev_edges,
+                  what + ", edges");
+        }
+    }
+}
+
+void TestMinPlusKernels() {
+    TestScalarMinPlusKernel<float>("float");
+    TestScalarMinPlusKernel<double>("double");
+    if (!graph::HasVectorMinPlusKernel()) {
+        std::cerr << "No vector min-plus kernel on this CPU, skipped"
+                  << std::endl;
+        return;
+    }
+    TestVectorMinPlusKernel<float>("float");
+    TestVectorMinPlusKernel<double>("double");
+}
+
+// A ring through every vertex, so they form one block, with random chords.
+graph::DirectedWeightedGraph<double> MakeRandomGraph(size_t vertex_count,
+                                                     size_t chord_count,
+                                                     unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<size_t> vertex_dist(0, vertex_count - 1);
+    std::uniform_real_distribution<double> weight_dist(1.0, 10.0);
+    graph::DirectedWeightedGraph<double> graph(vertex_count);
+    for (size_t vertex = 0; vertex < vertex_count; ++vertex) {
+        graph.AddEdge({vertex, (vertex + 1) % vertex_count,
+                       weight_dist(random)});
+    }
+    for (size_t i = 0; i < chord_count; ++i) {
+        graph.AddEdge(
+            {vertex_dist(random), vertex_dist(random), weight_dist(random)});
+    }
+    graph.Freeze();
+    return graph;
+}
+
+// A block wider than one column tile is relaxed by several threads at
+// once, which must give the same matrices as relaxing it alone.
+template <typename StoredWeight>
+void TestThreadedAllPairs(const std::string& type_name) {
+    constexpr size_t VERTEX_COUNT = 600;
+    const graph::DirectedWeightedGraph<double> graph =
+        MakeRandomGraph(VERTEX_COUNT, 3 * VERTEX_COUNT, 5);
+    parallel::ThreadPool thread_pool(4);
+    const graph::Router<double, StoredWeight> threaded(graph, &thread_pool);
+    const graph::Router<double, StoredWeight> serial(graph);
+    const graph::DijkstraRouter<double> dijkstra(graph);
+    const std::string what = "threaded all-pairs, " + type_name;
+
+    for (graph::VertexId from = 0; from < VERTEX_COUNT; ++from) {
+        for (graph::VertexId to = 0; to < VERTEX_COUNT; ++to) {
+            const auto threaded_route = threaded.BuildRoute(from, to);
+            const auto serial_route = serial.BuildRoute(from, to);
+            if (!threaded_route || !serial_route ||
+                threaded_route->weight != serial_route->weight ||
+                threaded_route->edges != serial_route->edges) {
+                Check(false, what + ", route " + std::to_string(from) +
+                                 " - " + std::to_string(to));
+                return;
+            }
+        }
+    }
+    for (graph::VertexId from = 0; from < VERTEX_COUNT; from += 37) {
+        for (graph::VertexId to = 0; to < VERTEX_COUNT; to += 41) {
+            const double expected = dijkstra.BuildRoute(from, to)->weight;
+            Check(std::abs(threaded.BuildRoute(from, to)->weight - expected) <=
+                      1e-5 * expected,
+                  what + ", weight " + std::to_string(from) + " - " +
+                      std::to_string(to));
+        }
+    }
+}
+
+void TestThreadedAllPairs() {
+    TestThreadedAllPairs<float>("float");
+    TestThreadedAllPairs<double>("double");
+}
+
+// Stops scattered around a point and buses riding back and forth between
+// a few of them, the same for a given seed.
+void FillRandomCatalogue(catalogue::TransportCatalogue& db, unsigned seed) {
+    constexpr int STOP_COUNT = 24;
+    constexpr int BUS_COUNT = 8;
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> offset_dist(-0.02, 0.02);
+    std::uniform_int_distribution<int> stop_dist(0, STOP_COUNT - 1);
+    std::uniform_int_distribution<int> length_dist(2, 6);
+    std::uniform_int_distribution<int> distance_dist(500, 3000);
+
+    std::vector<std::string_view> stops;
+    for (int i = 0; i < STOP_COUNT; ++i) {
+        stops.push_back((*db.AddStop("Stop " + std::to_string(i),
+                                     {55.6 + offset_dist(random),
+                                      37.6 + offset_dist(random)}))
+                            ->id);
+    }
+    for (int i = 0; i < BUS_COUNT; ++i) {
+        std::vector<std::string_view> route;
+        const int length = length_dist(random);
+        for (int j = 0; j < length; ++j) {
+            std::string_view stop = stops[stop_dist(random)];
+            if (route.empty() || route.back() != stop) {
+                route.push_back(stop);
+            }
+        }
+        for (int j = static_cast<int>(route.size()) - 2; j >= 0; --j) {
+            route.push_back(route[j]);
+        }
+        for (size_t j = 1; j < route.size(); ++j) {
+            db.AddDistances(route[j - 1], route[j], distance_dist(random));
+        }
+        db.AddBus("Bus " + std::to_string(i), route, false);
+    }
+}
+
+std::string DescribeSettings(const router::RoutingSettings& settings) {
+    return "engine " + std::to_string(static_cast<int>(settings.engine)) +
+           ", graph model " +
+           std::to_string(static_cast<int>(settings.graph_model)) +
+           (settings.prune_parallel_edges ? ", pruned" : "");
+}
+
+const std::vector<router::EngineType> ENGINES = {
+    router::EngineType::ALL_PAIRS,
+    router::EngineType::DIJKSTRA,
+    router::EngineType::A_STAR,
+    router::EngineType::CONTRACTION_HIERARCHY,
+    router::EngineType::RAPTOR,
+    router::EngineType::HUB_LABELS};
+
+const std::vector<router::GraphModel> GRAPH_MODELS = {
+    router::GraphModel::STOP_PAIRS, router::GraphModel::ROUTE_EXPANDED};
+
+router::RoutingSettings MakeSettings(router::EngineType engine,
+                                     router::GraphModel graph_model) {
+    router::RoutingSettings settings;
+    settings.bus_velocity = 40.0;
+    settings.bus_wait_time = 6;
+    settings.engine = engine;
+    settings.graph_model = graph_model;
+    return settings;
+}
+
+// Routes from one stop to all others, read off one shared search, match
+// the routes searched one at a time, settled vertex counts included.
+void TestBatchedRoutes() {
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 3);
+    const router::TransportRouter router(
+        MakeSettings(router::EngineType::DIJKSTRA,
+                     router::GraphModel::STOP_PAIRS),
+        db);
+
+    std::vector<std::string_view> stops;
+    for (const auto& stop : *db.GetAllStops()) {
+        stops.push_back(stop.id);
+    }
+    for (const std::string_view from : stops) {
+        const std::vector<std::optional<router::RouteInfo>> routes =
+            router.GetRouteInfos(from, stops);
+        for (size_t i = 0; i < stops.size(); ++i) {
+            const std::optional<router::RouteInfo> route =
+                router.GetRouteInfo(from, stops[i]);
+            const std::string what = "batched route " + std::string(from) +
+                                     " - " + std::string(stops[i]);
+            Check(routes[i].has_value() == route.has_value(), what);
+            if (routes[i] && route) {
+                Check(routes[i]->total_time == route->total_time,
+                      what + ", time");
+                Check(routes[i]->settled_count == route->settled_count,
+                      what + ", settled count");
+            }
+        }
+    }
+}
+
+// The stops a route waits at, one for every bus it boards.
+std::vector<std::string_view> GetBoardingStops(const router::RouteInfo& route) {
+    std::vector<std::string_view> stops;
+    for (const router::RouteItem& item : route.items) {
+        if (const auto* wait = std::get_if<router::WaitItem>(&item)) {
+            stops.push_back(wait->stop_name);
+        }
+    }
+    return stops;
+}
+
+// Alternatives start with the best route and go on in order of time, none
+// slower than the stretch allows, boarding at no stop twice and none the
+// same as another. Times are compared up to rounding, as routes of equal
+// time may add their items up in another order.
+void CheckAlternatives(const router::TransportRouter& router,
+                       std::string_view from, std::string_view to,
+                       double stretch, const std::string& what) {
+    const std::vector<router::RouteInfo> routes =
+        router.GetAlternativeRouteInfos(from, to, 4);
+    const std::optional<router::RouteInfo> best = router.GetRouteInfo(from, to);
+    Check(routes.empty() == !best, what + ", found");
+    if (routes.empty() || !best) {
+        return;
+    }
+    Check(std::abs(routes.front().total_time - best->total_time) < 1e-9,
+          what + ", best first");
+    for (size_t i = 0; i < routes.size(); ++i) {
+        const router::RouteInfo& route = routes[i];
+        Check(route.total_time <= best->total_time * stretch + 1e-9,
+              what + ", stretch");
+        if (i > 0) {
+            Check(routes[i - 1].total_time <= route.total_time + 1e-9,
+                  what + ", order");
+        }
+        std::vector<std::string_view> stops = GetBoardingStops(route);
+        std::sort(stops.begin(), stops.end());
+        Check(std::adjacent_find(stops.begin(), stops.end()) == stops.end() &&
+                  !std::binary_search(stops.begin(), stops.end(), to),
+              what + ", loopless");
+        for (size_t j = 0; j < i; ++j) {
+            Check(!(routes[j].items == route.items), what + ", duplicate");
+        }
+    }
+}
+
+void TestAlternatives() {
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 5);
+    for (const router::GraphModel graph_model : GRAPH_MODELS) {
+        const router::RoutingSettings settings =
+            MakeSettings(router::EngineType::DIJKSTRA, graph_model);
+        const router::TransportRouter router(settings, db);
+        for (const auto& from : *db.GetAllStops()) {
+            for (const auto& to : *db.GetAllStops()) {
+                CheckAlternatives(router, from.id, to.id,
+                                  settings.alternatives_stretch,
+                                  "alternatives, " +
+                                      DescribeSettings(settings) +
+                                      ", route " + from.id + " - " + to.id);
+            }
+        }
+    }
+
+    // A bus passing the same stops twice rides between them on two edges
+    // that give the same items.
+    catalogue::TransportCatalogue loop_db;
+    for (const char* stop : {"A", "B", "C", "D"}) {
+        loop_db.AddStop(stop, {55.6, 37.6});
+    }
+    for (const auto& [from, to] :
+         std::vector<std::pair<std::string, std::string>>{
+             {"A", "B"}, {"B", "C"}, {"C", "A"}, {"A", "D"}, {"D", "B"}}) {
+        loop_db.AddDistances(from, to, 1000);
+    }
+    loop_db.AddBus("Loop", {"A", "B", "C", "A", "B", "C", "A"}, true);
+    loop_db.AddBus("Cross", {"A", "D", "B"}, false);
+    for (const router::GraphModel graph_model : GRAPH_MODELS) {
+        router::RoutingSettings settings =
+            MakeSettings(router::EngineType::DIJKSTRA, graph_model);
+        settings.alternatives_stretch = 3.0;
+        const router::TransportRouter router(settings, loop_db);
+        CheckAlternatives(router, "A", "B", settings.alternatives_stretch,
+                          "alternatives on a loop, " +
+                              DescribeSettings(settings));
+    }
+}
+
+// Every stop pair has the same route from both routers, or no route from
+// either. Times may differ in the last bits, as the all-pairs engine adds
+// the edges up in another order when it recomputes a row. Settled counts
+// depend on the order edges were added in, so only their presence is
+// compared.
+void CheckSameRoutes(const catalogue::TransportCatalogue& db,
+                     const router::TransportRouter& repaired,
+                     const router::TransportRouter& rebuilt,
+                     const std::string& what) {
+    for (const auto& from : *db.GetAllStops()) {
+        for (const auto& to : *db.GetAllStops()) {
+            const std::optional<router::RouteInfo> repaired_route =
+                repaired.GetRouteInfo(from.id, to.id);
+            const std::optional<router::RouteInfo> rebuilt_route =
+                rebuilt.GetRouteInfo(from.id, to.id);
+            const bool is_same =
+                repaired_route.has_value() == rebuilt_route.has_value() &&
+                (!repaired_route ||
+                 (std::abs(repaired_route->total_time -
+                           rebuilt_route->total_time) < 1e-9 &&
+                  repaired_route->items == rebuilt_route->items &&
+                  repaired_route->settled_count.has_value() ==
+                      rebuilt_route->settled_count.has_value()));
+            if (!is_same) {
+                Check(false, what + ", route " + from.id + " - " + to.id);
+                return;
+            }
+        }
+    }
+}
+
+// Changes distances and adds a bus through a new stop, repairing the
+// router after each change, then compares it with one built from scratch.
+void TestIncrementalUpdates(const router::RoutingSettings& settings) {
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 7);
+    router::TransportRouter router(settings, db);
+    const std::string what =
+        "incremental update, " + DescribeSettings(settings);
+
+    std::mt19937 random(11);
+    std::vector<std::pair<std::string_view, std::string_view>> segments;
+    for (const auto& bus : *db.GetAllBuses()) {
+        for (size_t i = 1; i < bus.route.size(); ++i) {
+            segments.emplace_back(bus.route[i - 1]->id, bus.route[i]->id);
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        const auto [from, to] = segments[random() % segments.size()];
+        // Longer and shorter roads in turn, to both lose and gain routes.
+        db.AddDistances(from, to, i % 2 == 0 ? 6000 : 100);
+        router.UpdateDistance(from, to);
+        CheckSameRoutes(db, router, router::TransportRouter(settings, db),
+                        what + ", distance change " + std::to_string(i));
+    }
+
+    const std::string_view new_stop =
+        (*db.AddStop("New stop", {55.6, 37.6}))->id;
+    const std::string_view first_stop = segments.front().first;
+    const std::string_view last_stop = segments.back().second;
+    std::vector<std::string_view> route{new_stop, first_stop, last_stop,
+                                        new_stop};
+    for (size_t i = 1; i < route.size(); ++i) {
+        db.AddDistances(route[i - 1], route[i], 1000);
+    }
+    router.AddBus((*db.AddBus("New bus", route, true))->id);
+    CheckSameRoutes(db, router, router::TransportRouter(settings, db),
+                    what + ", new bus");
+
+    // A bus the router already has, then a change on its roads.
+    router.AddBus("New bus");
+    db.AddDistances(first_stop, last_stop, 300);
+    router.UpdateDistance(first_stop, last_stop);
+    CheckSameRoutes(db, router, router::TransportRouter(settings, db),
+                    what + ", bus added again");
+}
+
+void TestIncrementalUpdates() {
+    for (const router::EngineType engine : ENGINES) {
+        for (const router::GraphModel graph_model : GRAPH_MODELS) {
+            for (const bool prune_parallel_edges : {false, true}) {
+                router::RoutingSettings settings =
+                    MakeSettings(engine, graph_model);
+                settings.prune_parallel_edges = prune_parallel_edges;
+                settings.thread_count = 2;
+                TestIncrementalUpdates(settings);
+            }
+        }
+    }
+}
+
+// Best times from a stop with at most bus_count buses, for every bus_count
+// up to max_bus_count, worked out ride by ride from the catalogue alone:
+// times[bus_count] holds every stop reached.
+std::vector<std::unordered_map<std::string_view, double>>
+ComputeTimesByBusCount(const catalogue::TransportCatalogue& db,
+                       const router::RoutingSettings& settings,
+                       std::string_view from, size_t max_bus_count) {
+    std::vector<std::unordered_map<std::string_view, double>> times(
+        max_bus_count + 1);
+    times[0][from] = 0.0;
+    for (size_t bus_count = 1; bus_count <= max_bus_count; ++bus_count) {
+        const std::unordered_map<std::string_view, double>& prev_times =
+            times[bus_count - 1];
+        std::unordered_map<std::string_view, double>& next_times =
+            times[bus_count];
+        next_times = prev_times;
+        for (const auto& bus : *db.GetAllBuses()) {
+            for (size_t i = 0; i + 1 < bus.route.size(); ++i) {
+                const auto start = prev_times.find(bus.route[i]->id);
+                if (start == prev_times.end()) {
+                    continue;
+                }
+                double time = start->second + settings.bus_wait_time;
+                for (size_t j = i + 1; j < bus.route.size(); ++j) {
+                    const int distance = db.GetDistance(bus.route[j - 1]->id,
+                                                        bus.route[j]->id);
+                    time +=
+                        (distance / 1000.0) / (settings.bus_velocity / 60.0);
+                    const auto [it, inserted] =
+                        next_times.emplace(bus.route[j]->id, time);
+                    if (!inserted && time < it->second) {
+                        it->second = time;
+                    }
+                }
+            }
+        }
+    }
+    return times;
+}
+
+// Best times from a stop with any number of buses.
+std::unordered_map<std::string_view, double> ComputeTimes(
+    const catalogue::TransportCatalogue& db,
+    const router::RoutingSettings& settings, std::string_view from) {
+    return ComputeTimesByBusCount(db, settings, from,
+                                  db.GetAllStops()->size())
+        .back();
+}
+
+bool IsSameTime(std::optional<double> time, std::optional<double> expected) {
+    return time.has_value() == expected.has_value() &&
+           (!time || std::abs(*time - *expected) < 1e-9);
+}
+
+std::optional<double> FindTime(
+    const std::unordered_map<std::string_view, double>& times,
+    std::string_view stop) {
+    const auto it = times.find(stop);
+    return it == times.end() ? std::nullopt : std::make_optional(it->second);
+}
+
+size_t CountBuses(const router::RouteInfo& route) {
+    return GetBoardingStops(route).size();
+}
+
+// A route waits and rides in turn, starting with a wait at its first stop,
+// and its items add up to its time.
+void CheckRouteItems(const router::RouteInfo& route,
+                     const router::RoutingSettings& settings,
+                     std::string_view from, const std::string& what) {
+    double time = 0.0;
+    for (size_t i = 0; i < route.items.size(); ++i) {
+        const auto* wait = std::get_if<router::WaitItem>(&route.items[i]);
+        if (i % 2 == 0) {
+            Check(wait && wait->time == settings.bus_wait_time &&
+                      (i > 0 || wait->stop_name == from),
+                  what + ", wait");
+        } else {
+            Check(!wait, what + ", ride");
+        }
+        time += std::visit([](const auto& item) { return item.time; },
+                           route.items[i]);
+    }
+    Check(route.items.size() % 2 == 0, what + ", last item");
+    Check(std::abs(time - route.total_time) < 1e-9, what + ", items time");
+}
+
+// Every engine finds the fastest routes of the reference, for single
+// routes and for a whole matrix.
+void TestRouteTimes() {
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 9);
+    std::vector<std::string_view> stops;
+    for (const auto& stop : *db.GetAllStops()) {
+        stops.push_back(stop.id);
+    }
+    const router::RoutingSettings reference_settings =
+        MakeSettings(router::EngineType::DIJKSTRA,
+                     router::GraphModel::STOP_PAIRS);
+    std::vector<std::unordered_map<std::string_view, double>> times;
+    for (const std::string_view from : stops) {
+        times.push_back(ComputeTimes(db, reference_settings, from));
+    }
+
+    for (const router::EngineType engine : ENGINES) {
+        for (const router::GraphModel graph_model : GRAPH_MODELS) {
+            const router::RoutingSettings settings =
+                MakeSettings(engine, graph_model);
+            const router::TransportRouter router(settings, db);
+            const std::vector<std::vector<std::optional<double>>> matrix =
+                router.GetTravelTimeMatrix(stops, stops);
+            for (size_t row = 0; row < stops.size(); ++row) {
+                for (size_t column = 0; column < stops.size(); ++column) {
+                    const std::string what =
+                        DescribeSettings(settings) + ", route " +
+                        std::string(stops[row]) + " - " +
+                        std::string(stops[column]);
+                    const std::optional<double> expected =
+                        FindTime(times[row], stops[column]);
+                    const std::optional<router::RouteInfo> route =
+                        router.GetRouteInfo(stops[row], stops[column]);
+                    Check(IsSameTime(route ? std::make_optional(
+                                                 route->total_time)
+                                           : std::nullopt,
+                                     expected),
+                          "route time, " + what);
+                    if (route) {
+                        CheckRouteItems(*route, settings, stops[row],
+                                        "route items, " + what);
+                    }
+                    Check(IsSameTime(matrix[row][column], expected),
+                          "matrix time, " + what);
+                }
+            }
+        }
+    }
+}
+
+// With a transfer limit a route is the fastest of the reference with at
+// most one bus more than the limit.
+void TestTransferLimits() {
+    constexpr size_t MAX_TRANSFERS = 2;
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 10);
+    for (const router::EngineType engine :
+         {router::EngineType::RAPTOR, router::EngineType::DIJKSTRA}) {
+        const router::RoutingSettings settings =
+            MakeSettings(engine, router::GraphModel::STOP_PAIRS);
+        const router::TransportRouter router(settings, db);
+        for (const auto& from : *db.GetAllStops()) {
+            const auto times = ComputeTimesByBusCount(db, settings, from.id,
+                                                      MAX_TRANSFERS + 1);
+            for (const auto& to : *db.GetAllStops()) {
+                for (size_t max_transfers = 0; max_transfers <= MAX_TRANSFERS;
+                     ++max_transfers) {
+                    const std::string what =
+                        "transfer limit " + std::to_string(max_transfers) +
+                        ", " + DescribeSettings(settings) + ", route " +
+                        from.id + " - " + to.id;
+                    const std::optional<router::RouteInfo> route =
+                        router.GetRouteInfo(from.id, to.id, max_transfers);
+                    Check(IsSameTime(route ? std::make_optional(
+                                                 route->total_time)
+                                           : std::nullopt,
+                                     FindTime(times[max_transfers + 1],
+                                              to.id)),
+                          what + ", time");
+                    if (route) {
+                        Check(CountBuses(*route) <= max_transfers + 1,
+                              what + ", buses");
+                    }
+                }
+            }
+        }
+    }
+}
+
+// The front holds, fastest first, the best route with every number of
+// buses that is faster than with one bus fewer.
+void TestParetoFronts() {
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 11);
+    const size_t max_bus_count = db.GetAllStops()->size();
+    for (const router::EngineType engine :
+         {router::EngineType::RAPTOR, router::EngineType::DIJKSTRA}) {
+        for (const router::GraphModel graph_model : GRAPH_MODELS) {
+            const router::RoutingSettings settings =
+                MakeSettings(engine, graph_model);
+            const router::TransportRouter router(settings, db);
+            for (const auto& from : *db.GetAllStops()) {
+                const auto times = ComputeTimesByBusCount(db, settings,
+                                                          from.id,
+                                                          max_bus_count);
+                for (const auto& to : *db.GetAllStops()) {
+                    if (from.id == to.id) {
+                        continue;
+                    }
+                    std::vector<std::pair<double, size_t>> expected;
+                    for (size_t bus_count = 1; bus_count <= max_bus_count;
+                         ++bus_count) {
+                        const std::optional<double> time =
+                            FindTime(times[bus_count], to.id);
+                        if (time && (expected.empty() ||
+                                     *time < expected.back().first - 1e-9)) {
+                            expected.emplace_back(*time, bus_count);
+                        }
+                    }
+                    std::reverse(expected.begin(), expected.end());
+
+                    const std::string what = "Pareto front, " +
+                                             DescribeSettings(settings) +
+                                             ", route " + from.id + " - " +
+                                             to.id;
+                    const std::vector<router::RouteInfo> routes =
+                        router.GetParetoRouteInfos(from.id, to.id).routes;
+                    if (routes.size() != expected.size()) {
+                        Check(false, what + ", size");
+                        continue;
+                    }
+                    for (size_t i = 0; i < routes.size(); ++i) {
+                        Check(std::abs(routes[i].total_time -
+                                       expected[i].first) < 1e-9 &&
+                                  CountBuses(routes[i]) == expected[i].second,
+                              what + ", route " + std::to_string(i));
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Reachable stops are the stops of the reference within the time, the
+// first stop included, sorted by time.
+void TestReachableStops() {
+    constexpr double MAX_TIME = 25.0;
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 12);
+    for (const router::EngineType engine :
+         {router::EngineType::RAPTOR, router::EngineType::DIJKSTRA}) {
+        for (const router::GraphModel graph_model : GRAPH_MODELS) {
+            const router::RoutingSettings settings =
+                MakeSettings(engine, graph_model);
+            const router::TransportRouter router(settings, db);
+            for (const auto& from : *db.GetAllStops()) {
+                const std::string what = "reachable stops, " +
+                                         DescribeSettings(settings) +
+                                         ", from " + from.id;
+                const std::vector<router::ReachableStop> reachable_stops =
+                    router.GetReachableStops(from.id, MAX_TIME);
+                const auto times = ComputeTimes(db, settings, from.id);
+                size_t expected_count = 0;
+                for (const auto& [stop, time] : times) {
+                    expected_count += time <= MAX_TIME;
+                }
+                Check(reachable_stops.size() == expected_count,
+                      what + ", count");
+                for (size_t i = 0; i < reachable_stops.size(); ++i) {
+                    const router::ReachableStop& stop = reachable_stops[i];
+                    Check(IsSameTime(stop.time,
+                                     FindTime(times, stop.stop_name)),
+                          what + ", " + std::string(stop.stop_name));
+                    if (i > 0) {
+                        Check(reachable_stops[i - 1].time <= stop.time,
+                              what + ", order");
+                    }
+                }
+            }
+        }
+    }
+}
+
+// A router saved to a file and mapped back gives the same routes; a file
+// for another graph or a cut-off one is refused.
+template <typename StoredWeight>
+void TestRouterFile(const std::string& type_name) {
+    using AllPairsRouter = graph::Router<double, StoredWeight>;
+    constexpr size_t VERTEX_COUNT = 80;
+    const graph::DirectedWeightedGraph<double> graph =
+        MakeRandomGraph(VERTEX_COUNT, 3 * VERTEX_COUNT, 13);
+    const graph::DirectedWeightedGraph<double> other_graph =
+        MakeRandomGraph(VERTEX_COUNT, 3 * VERTEX_COUNT, 14);
+    const std::string what = "router file, " + type_name;
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path() /
+        ("router_tests_" + type_name + ".bin");
+
+    const AllPairsRouter router(graph);
+    {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        router.Save(output);
+    }
+    const std::unique_ptr<AllPairsRouter> loaded =
+        AllPairsRouter::Load(graph, memory::MappedFile::Open(path.string()));
+    Check(loaded != nullptr, what + ", loaded");
+    if (loaded) {
+        for (graph::VertexId from = 0; from < VERTEX_COUNT; ++from) {
+            for (graph::VertexId to = 0; to < VERTEX_COUNT; ++to) {
+                const auto route = router.BuildRoute(from, to);
+                const auto loaded_route = loaded->BuildRoute(from, to);
+                Check(route && loaded_route &&
+                          route->weight == loaded_route->weight &&
+                          route->edges == loaded_route->edges,
+                      what + ", route " + std::to_string(from) + " - " +
+                          std::to_string(to));
+            }
+        }
+    }
+    Check(!AllPairsRouter::Load(other_graph,
+                                memory::MappedFile::Open(path.string())),
+          what + ", another graph");
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+    Check(!AllPairsRouter::Load(graph,
+                                memory::MappedFile::Open(path.string())),
+          what + ", truncated");
+    std::filesystem::remove(path);
+}
+
+// The transport router maps the matrices it saved on an earlier start, and
+// computes them again when the file is stale or cut off.
+void TestRouterCacheFile() {
+    TestRouterFile<double>("double");
+    TestRouterFile<float>("float");
+
+    catalogue::TransportCatalogue db;
+    FillRandomCatalogue(db, 4);
+    const router::RoutingSettings settings = MakeSettings(
+        router::EngineType::ALL_PAIRS, router::GraphModel::STOP_PAIRS);
+    router::RoutingSettings cached_settings = settings;
+    const std::filesystem::path path =
+        std::filesystem::temp_directory_path() / "router_tests_cache.bin";
+    std::filesystem::remove(path);
+    cached_settings.router_cache_file = path.string();
+
+    const router::TransportRouter saved(cached_settings, db);
+    Check(std::filesystem::exists(path), "router cache file, saved");
+    CheckSameRoutes(db, router::TransportRouter(cached_settings, db), saved,
+                    "router cache file, loaded");
+
+    const auto& bus = db.GetAllBuses()->front();
+    db.AddDistances(bus.route[0]->id, bus.route[1]->id, 100);
+    CheckSameRoutes(db, router::TransportRouter(cached_settings, db),
+                    router::TransportRouter(settings, db),
+                    "router cache file, stale");
+
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+    CheckSameRoutes(db, router::TransportRouter(cached_settings, db),
+                    router::TransportRouter(settings, db),
+                    "router cache file, truncated");
+    std::filesystem::remove(path);
+}
+
+}  // namespace
+
+int main() {
+    TestMinPlusKernels();
+    TestThreadedAllPairs();
+    TestBatchedRoutes();
+    TestAlternatives();
+    TestRouteTimes();
+    TestTransferLimits();
+    TestParetoFronts();
+    TestReachableStops();
+    TestIncrementalUpdates();
+    TestRouterCacheFile();
+    if (failure_count > 0) {
+        std::cerr << failure_count << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cerr << "All checks passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace parallel {
+
+ThreadPool::ThreadPool(size_t thread_count) {
+    for (size_t i = 1; i < thread_count; ++i) {
+        workers_.emplace_back([this] { WorkerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        is_stopping_ = true;
+    }
+    batch_started_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::GetThreadCount() const { return workers_.size() + 1; }
+
+size_t ThreadPool::GetDefaultThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void ThreadPool::ParallelFor(size_t task_count,
+                             const std::function<void(size_t)>& task) {
+    if (task_count == 0) {
+        return;
+    }
+    if (workers_.empty() || task_count == 1) {
+        for (size_t index = 0; index < task_count; ++index) {
+            task(index);
+        }
+        return;
+    }
+
+    std::lock_guard batch_lock(batch_mutex_);
+    {
+        // A worker that woke up late for the previous batch may still be
+        // looking at its counters.
+        std::unique_lock lock(mutex_);
+        batch_finished_.wait(lock, [this] { return active_workers_ == 0; });
+        task_ = &task;
+        task_count_ = task_count;
+        next_index_ = 0;
+        finished_count_ = 0;
+        error_ = nullptr;
+        ++batch_id_;
+        ++active_workers_;
+    }
+    batch_started_.notify_all();
+
+    RunTasks();
+
+    std::unique_lock lock(mutex_);
+    batch_finished_.wait(lock,
+                         [this] { return finished_count_ == task_count_; });
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    size_t seen_batch_id = 0;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            batch_started_.wait(lock, [&] {
+                return is_stopping_ || batch_id_ != seen_batch_id;
+            });
+            if (is_stopping_) {
+                return;
+            }
+            seen_batch_id = batch_id_;
+            ++active_workers_;
+        }
+        RunTasks();
+    }
+}
+
+void ThreadPool::RunTasks() {
+    size_t finished = 0;
+    for (size_t index = next_index_++; index < task_count_;
+         index = next_index_++) {
+        try {
+            (*task_)(index);
+        } catch (...) {
+            std::lock_guard lock(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        ++finished;
+    }
+
+    std::lock_guard lock(mutex_);
+    finished_count_ += finished;
+    --active_workers_;
+    batch_finished_.notify_all();
+}
+
+}  // namespace parallel
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// Fixed set of worker threads that run one batch of indexed tasks at a time.
+class ThreadPool {
+   public:
+    // thread_count counts the calling thread, so a pool of one thread runs
+    // every task inline.
+    explicit ThreadPool(size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t GetThreadCount() const;
+
+    // Calls task(index) for every index in [0, task_count) and returns when
+    // all calls have finished. The first exception thrown by a task is
+    // rethrown here.
+    void ParallelFor(size_t task_count,
+                     const std::function<void(size_t)>& task);
+
+    static size_t GetDefaultThreadCount();
+
+   private:
+    void WorkerLoop();
+    void RunTasks();
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable batch_started_;
+    std::condition_variable batch_finished_;
+    std::mutex batch_mutex_;
+
+    const std::function<void(size_t)>* task_ = nullptr;
+    size_t task_count_ = 0;
+    std::atomic<size_t> next_index_{0};
+    size_t finished_count_ = 0;
+    size_t active_workers_ = 0;
+    size_t batch_id_ = 0;
+    bool is_stopping_ = false;
+    std::exception_ptr error_;
+};
+
+}  // namespace parallel
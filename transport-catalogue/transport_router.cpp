@@ -1,14 +1,29 @@
 #include "transport_router.h"
 
+#include <algorithm>
 #include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
 #include <memory>
 #include <optional>
+#include <set>
+#include <stdexcept>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <unordered_map>
 
+#include "contraction_hierarchy.h"
+#include "dijkstra_router.h"
 #include "domain.h"
+#include "geo.h"
 #include "graph.h"
+#include "hub_labels.h"
+#include "loopless_routes.h"
+#include "mapped_file.h"
+#include "pareto_router.h"
 #include "router.h"
 #include "transport_catalogue.h"
 
@@ -16,95 +31,1005 @@
 #define METERS_PER_KILOMETER 1'000
 
 namespace router {
-TransportRouter::TransportRouter(double bus_velocity, int bus_wait_time,
+namespace {
+size_t CountGraphVertices(GraphModel graph_model,
+                          const catalogue::TransportCatalogue& db) {
+  if (graph_model == GraphModel::STOP_PAIRS) {
+    return db.GetStopCount() * 2;
+  }
+  size_t vertex_count = db.GetStopCount();
+  for (const auto& bus : *db.GetAllBuses()) {
+    vertex_count += bus.route.size();
+  }
+  return vertex_count;
+}
+
+// Whether the route leaves a bus and boards the same bus after the wait.
+bool ReboardsSameBus(const RouteInfo& route) {
+  std::optional<std::string_view> last_bus_name;
+  for (const RouteItem& item : route.items) {
+    const BusItem* bus_item = std::get_if<BusItem>(&item);
+    if (!bus_item) {
+      continue;
+    }
+    if (last_bus_name == bus_item->bus_name) {
+      return true;
+    }
+    last_bus_name = bus_item->bus_name;
+  }
+  return false;
+}
+
+constexpr size_t MAX_SKIPPED_PER_ALTERNATIVE = 4;
+
+template <typename StoredWeight>
+size_t GetMatrixBytes(const graph::RouterEngine<double>* engine) {
+  return dynamic_cast<const graph::Router<double, StoredWeight>&>(*engine)
+      .GetMatrixBytes();
+}
+
+// A route taken from the cache settled no vertices this time.
+std::optional<RouteInfo> MarkAsCached(std::optional<RouteInfo> route) {
+  if (route && route->settled_count) {
+    route->settled_count = 0;
+  }
+  return route;
+}
+
+// Maps the matrices from cache_file when it was saved for this very graph.
+// Otherwise they are computed and saved there, through a temporary file
+// renamed over the old one, so that a process mapping the old file keeps
+// valid pages and no process ever maps a half-written one.
+template <typename StoredWeight>
+std::unique_ptr<graph::RouterEngine<double>> MakeAllPairsRouter(
+    const graph::DirectedWeightedGraph<double>& graph,
+    parallel::ThreadPool* thread_pool, const std::string& cache_file) {
+  using AllPairsRouter = graph::Router<double, StoredWeight>;
+  if (cache_file.empty()) {
+    return std::make_unique<AllPairsRouter>(graph, thread_pool);
+  }
+  if (auto file = memory::MappedFile::Open(cache_file)) {
+    if (auto router = AllPairsRouter::Load(graph, std::move(file))) {
+      return router;
+    }
+  }
+
+  auto router = std::make_unique<AllPairsRouter>(graph, thread_pool);
+  const std::string temporary_file = cache_file + ".tmp";
+  {
+    std::ofstream output(temporary_file, std::ios::binary | std::ios::trunc);
+    router->Save(output);
+    if (!output.flush()) {
+      throw std::runtime_error("cannot write router cache file " +
+                               temporary_file);
+    }
+  }
+  std::filesystem::rename(temporary_file, cache_file);
+  return router;
+}
+}  // namespace
+
+TransportRouter::TransportRouter(const RoutingSettings& settings,
                                  const catalogue::TransportCatalogue& db)
     : db_(db),
-      graph_(db_.GetStopCount() * 2),
-      bus_velocity_(bus_velocity),
-      bus_wait_time_(bus_wait_time) {
+      thread_count_(settings.thread_count),
+      graph_(settings.engine == EngineType::RAPTOR
+                 ? 0
+                 : CountGraphVertices(settings.graph_model, db_)),
+      route_cache_(settings.route_cache_size),
+      bus_velocity_(settings.bus_velocity),
+      bus_wait_time_(settings.bus_wait_time),
+      engine_(settings.engine),
+      matrix_weight_(settings.matrix_weight),
+      graph_model_(settings.graph_model),
+      vertex_order_(settings.vertex_order),
+      prune_parallel_edges_(settings.prune_parallel_edges),
+      alternatives_stretch_(settings.alternatives_stretch),
+      router_cache_file_(settings.router_cache_file) {
+  vertex_stop_names_.reserve(graph_.GetVertexCount());
+  vertex_coordinates_.reserve(graph_.GetVertexCount());
   BuildRouter();
 }
 
 void TransportRouter::AddStopToGraph(std::string_view stop_name) {
   if (!stop_name_to_in_vertex_id_.count(stop_name)) {
-    vertex_id_to_stop_name_[current_vertex_id_] = stop_name;
+    const geo::Coordinates coords = db_.FindStop(stop_name)->coords;
+    vertex_coordinates_.push_back(coords);
+    vertex_stop_names_.push_back(stop_name);
     stop_name_to_in_vertex_id_[stop_name] = current_vertex_id_;
     ++current_vertex_id_;
-    vertex_id_to_stop_name_[current_vertex_id_] = stop_name;
+    if (graph_model_ == GraphModel::ROUTE_EXPANDED) {
+      // Boarding edges carry the wait in this model.
+      return;
+    }
+    vertex_coordinates_.push_back(coords);
+    vertex_stop_names_.push_back(stop_name);
     ++current_vertex_id_;
-    graph::EdgeId edge =
-        graph_.AddEdge({current_vertex_id_ - 2, current_vertex_id_ - 1,
-                        (double)bus_wait_time_});
-    waiting_edges_.insert(edge);
+    graph_.AddEdge({current_vertex_id_ - 2, current_vertex_id_ - 1,
+                    (double)bus_wait_time_},
+                   {EdgeKind::WAIT, 0, nullptr});
   }
 }
 
 void TransportRouter::AddBusToGraph(catalogue::TransportCatalogue::BusPtr bus) {
-  auto bus_route = bus->route;
-  for (auto it_l = bus_route.begin(); it_l != bus_route.end() - 1; ++it_l) {
-    std::string_view stop_from_name = (*it_l)->id;
-    size_t current_span_count = 0;
-    double current_travel_time = 0.0;
-    for (auto it_r = it_l + 1; it_r != bus_route.end(); ++it_r) {
-      std::string_view stop_to_name = (*it_r)->id;
-      graph::VertexId stop_from_id, stop_to_id;
-      stop_from_id = stop_name_to_in_vertex_id_.at(stop_from_name) + 1;
-      stop_to_id = stop_name_to_in_vertex_id_.at(stop_to_name);
+  AddBusEdges(bus, MakeBusEdges(bus, current_vertex_id_));
+}
+
+// Reads the catalogue and the stop vertices only, so buses may be turned
+// into edges concurrently once every stop has its vertex. Ride vertices of
+// the route-expanded model are numbered from first_ride_vertex on.
+TransportRouter::BusEdges TransportRouter::MakeBusEdges(
+    catalogue::TransportCatalogue::BusPtr bus,
+    graph::VertexId first_ride_vertex) const {
+  const std::vector<double> travel_times = ComputeBusTravelTimes(bus);
+  const auto& bus_route = bus->route;
+  BusEdges result;
+  const auto add_edge = [&result](const graph::Edge<double>& edge,
+                                  const EdgePayload& payload) {
+    result.edges.push_back(edge);
+    result.payloads.push_back(payload);
+  };
 
-      ++current_span_count;
-      std::string_view prev_stop = (*(it_r - 1))->id;
-      current_travel_time +=
-          GetTravelTime(db_.GetDistance(prev_stop, stop_to_name));
-      graph::EdgeId edge =
-          graph_.AddEdge({stop_from_id, stop_to_id, current_travel_time});
-      edge_to_bus_name_[edge] = bus->id;
-      edge_to_span_count_[edge] = current_span_count;
+  if (graph_model_ == GraphModel::ROUTE_EXPANDED) {
+    for (size_t i = 0; i < bus_route.size(); ++i) {
+      const graph::VertexId stop_id =
+          stop_name_to_in_vertex_id_.at(bus_route[i]->id);
+      const graph::VertexId ride_id = first_ride_vertex + i;
+      if (i + 1 < bus_route.size()) {
+        add_edge({stop_id, ride_id, (double)bus_wait_time_},
+                 {EdgeKind::WAIT, 0, nullptr});
+      }
+      if (i > 0) {
+        add_edge({ride_id - 1, ride_id, travel_times[i - 1]},
+                 {EdgeKind::RIDE, 1, bus});
+        add_edge({ride_id, stop_id, 0.0}, {EdgeKind::ALIGHT, 0, nullptr});
+      }
+    }
+    return result;
+  }
+
+  result.edges.reserve(travel_times.size());
+  result.payloads.reserve(travel_times.size());
+  size_t travel_index = 0;
+  for (size_t from = 0; from + 1 < bus_route.size(); ++from) {
+    const graph::VertexId stop_from_id =
+        stop_name_to_in_vertex_id_.at(bus_route[from]->id) + 1;
+    for (size_t to = from + 1; to < bus_route.size(); ++to) {
+      const graph::VertexId stop_to_id =
+          stop_name_to_in_vertex_id_.at(bus_route[to]->id);
+      add_edge({stop_from_id, stop_to_id, travel_times[travel_index++]},
+               {EdgeKind::RIDE, static_cast<uint32_t>(to - from), bus});
+    }
+  }
+  return result;
+}
+
+void TransportRouter::AddBusEdges(catalogue::TransportCatalogue::BusPtr bus,
+                                  const BusEdges& bus_edges) {
+  if (graph_model_ == GraphModel::ROUTE_EXPANDED) {
+    for (const auto* stop : bus->route) {
+      vertex_coordinates_.push_back(stop->coords);
+      vertex_stop_names_.emplace_back();
+      ++current_vertex_id_;
+    }
+  }
+  std::vector<graph::EdgeId>& travel_edges = bus_travel_edges_[bus->id];
+  for (size_t i = 0; i < bus_edges.edges.size(); ++i) {
+    const graph::EdgeId edge_id =
+        graph_.AddEdge(bus_edges.edges[i], bus_edges.payloads[i]);
+    if (bus_edges.payloads[i].kind == EdgeKind::RIDE) {
+      travel_edges.push_back(edge_id);
+    }
+  }
+}
+
+// An edge is dropped when another edge between the same two vertices is
+// cheaper, or as cheap and added before it: no engine's best route can
+// need it, and ties keep the bus that searches pick without pruning.
+// Returns the number of edges dropped.
+size_t TransportRouter::PruneParallelEdges(
+    std::vector<BusEdges>& bus_edges) const {
+  struct BestEdge {
+    double weight;
+    size_t bus_index;
+    size_t edge_index;
+  };
+  const uint64_t vertex_count = graph_.GetVertexCount();
+  const auto get_key = [vertex_count](const graph::Edge<double>& edge) {
+    return edge.from * vertex_count + edge.to;
+  };
+  std::unordered_map<uint64_t, BestEdge> best_edges;
+  for (size_t i = 0; i < bus_edges.size(); ++i) {
+    const std::vector<graph::Edge<double>>& edges = bus_edges[i].edges;
+    for (size_t j = 0; j < edges.size(); ++j) {
+      const BestEdge candidate{edges[j].weight, i, j};
+      const auto [it, inserted] =
+          best_edges.emplace(get_key(edges[j]), candidate);
+      if (!inserted && candidate.weight < it->second.weight) {
+        it->second = candidate;
+      }
+    }
+  }
+
+  size_t pruned_count = 0;
+  for (size_t i = 0; i < bus_edges.size(); ++i) {
+    BusEdges& current = bus_edges[i];
+    size_t kept_count = 0;
+    for (size_t j = 0; j < current.edges.size(); ++j) {
+      const BestEdge& best = best_edges.at(get_key(current.edges[j]));
+      if (best.bus_index == i && best.edge_index == j) {
+        current.edges[kept_count] = current.edges[j];
+        current.payloads[kept_count] = current.payloads[j];
+        ++kept_count;
+      }
+    }
+    pruned_count += current.edges.size() - kept_count;
+    current.edges.resize(kept_count);
+    current.payloads.resize(kept_count);
+  }
+  return pruned_count;
+}
+
+// Travel times of a bus's riding edges in the order they are added to the
+// graph: from each stop to every later one for stop pairs, between
+// consecutive stops for ride edges. Each segment's distance is looked up
+// once; stop-pair times are then summed segment by segment from their first
+// stop, as they always were, so they stay bit-identical.
+std::vector<double> TransportRouter::ComputeBusTravelTimes(
+    catalogue::TransportCatalogue::BusPtr bus) const {
+  const auto& bus_route = bus->route;
+  std::vector<double> segment_times;
+  segment_times.reserve(bus_route.size());
+  for (size_t i = 1; i < bus_route.size(); ++i) {
+    segment_times.push_back(GetTravelTime(
+        db_.GetDistance(bus_route[i - 1]->id, bus_route[i]->id)));
+  }
+  if (graph_model_ == GraphModel::ROUTE_EXPANDED) {
+    return segment_times;
+  }
+  std::vector<double> travel_times;
+  travel_times.reserve(segment_times.size() * (segment_times.size() + 1) / 2);
+  for (size_t from = 0; from < segment_times.size(); ++from) {
+    double current_travel_time = 0.0;
+    for (size_t to = from; to < segment_times.size(); ++to) {
+      current_travel_time += segment_times[to];
+      travel_times.push_back(current_travel_time);
     }
   }
+  return travel_times;
 }
 
 void TransportRouter::BuildRouter() {
+  if (engine_ == EngineType::RAPTOR) {
+    // Scans the catalogue's routes directly, no graph is needed.
+    GetRaptorRouter();
+    return;
+  }
   const std::deque<Stop>* all_stops = db_.GetAllStops();
   const std::deque<Bus>* all_buses = db_.GetAllBuses();
-  for (const auto& stop : *all_stops) {
-    AddStopToGraph(stop.id);
+  if (vertex_order_ == VertexOrder::HILBERT) {
+    std::vector<geo::Coordinates> coordinates;
+    coordinates.reserve(all_stops->size());
+    for (const auto& stop : *all_stops) {
+      coordinates.push_back(stop.coords);
+    }
+    for (const size_t index : geo::ComputeHilbertOrder(coordinates)) {
+      AddStopToGraph((*all_stops)[index].id);
+    }
+  } else {
+    for (const auto& stop : *all_stops) {
+      AddStopToGraph(stop.id);
+    }
   }
+
+  // Buses become edges in parallel, one buffer per bus; the buffers are
+  // then appended in catalogue order, so edge ids do not depend on the
+  // thread count.
+  std::vector<catalogue::TransportCatalogue::BusPtr> buses;
+  std::vector<graph::VertexId> first_ride_vertices;
+  buses.reserve(all_buses->size());
+  first_ride_vertices.reserve(all_buses->size());
+  graph::VertexId next_ride_vertex = current_vertex_id_;
   for (const auto& bus : *all_buses) {
-    AddBusToGraph(&bus);
+    buses.push_back(&bus);
+    first_ride_vertices.push_back(next_ride_vertex);
+    if (graph_model_ == GraphModel::ROUTE_EXPANDED) {
+      next_ride_vertex += bus.route.size();
+    }
+  }
+  std::vector<BusEdges> bus_edges(buses.size());
+  const auto make_bus_edges = [&](size_t i) {
+    bus_edges[i] = MakeBusEdges(buses[i], first_ride_vertices[i]);
+  };
+  // Engines that search per query would start the pool for this alone.
+  if (engine_ == EngineType::DIJKSTRA || engine_ == EngineType::A_STAR) {
+    for (size_t i = 0; i < buses.size(); ++i) {
+      make_bus_edges(i);
+    }
+  } else {
+    GetThreadPool().ParallelFor(buses.size(), make_bus_edges);
+  }
+  if (prune_parallel_edges_) {
+    pruned_edge_count_ = PruneParallelEdges(bus_edges);
+  }
+  for (size_t i = 0; i < buses.size(); ++i) {
+    AddBusEdges(buses[i], bus_edges[i]);
+    bus_edges[i] = BusEdges();
+  }
+  graph_.Freeze();
+  components_ = graph::GraphComponents(graph_);
+  IndexWaitingEdges();
+  BuildEngine();
+}
+
+// Parallel edges left out at build time may become the cheapest once
+// distances change, so a pruned graph is built anew rather than patched.
+void TransportRouter::RebuildRouter() {
+  graph_ = graph::DirectedWeightedGraph<double, EdgePayload>(
+      CountGraphVertices(graph_model_, db_));
+  current_vertex_id_ = 0;
+  stop_name_to_in_vertex_id_.clear();
+  vertex_stop_names_.clear();
+  vertex_coordinates_.clear();
+  bus_travel_edges_.clear();
+  BuildRouter();
+  RepairRouter({});
+}
+
+// Pairs in different components are answered without a search, whatever
+// the engine. The round-based engine has no graph, so it finds them out
+// by searching.
+bool TransportRouter::MayReach(std::string_view from_stop,
+                               std::string_view to_stop) const {
+  if (engine_ == EngineType::RAPTOR) {
+    return true;
+  }
+  return components_.MayReach(stop_name_to_in_vertex_id_.at(from_stop),
+                              stop_name_to_in_vertex_id_.at(to_stop));
+}
+
+// Every Bus item of a route starts with a waiting edge, so flagging them
+// lets graph searches count Bus items.
+void TransportRouter::IndexWaitingEdges() {
+  is_waiting_edge_.assign(graph_.GetEdgeCount(), false);
+  for (graph::EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+    is_waiting_edge_[edge_id] =
+        graph_.GetPayload(edge_id).kind == EdgeKind::WAIT;
+  }
+}
+
+void TransportRouter::BuildEngine() {
+  switch (engine_) {
+    case EngineType::ALL_PAIRS:
+      BuildAllPairsRouter();
+      break;
+    case EngineType::DIJKSTRA:
+      router_ = std::make_unique<graph::DijkstraRouter<double>>(graph_);
+      break;
+    case EngineType::A_STAR:
+      ComputeMinRoadToGeoRatio();
+      router_ = std::make_unique<graph::DijkstraRouter<double>>(
+          graph_, [this](graph::VertexId from, graph::VertexId to) {
+            return GetTravelTimeLowerBound(from, to);
+          });
+      break;
+    case EngineType::CONTRACTION_HIERARCHY:
+      router_ =
+          std::make_unique<graph::ContractionHierarchyRouter<double>>(graph_);
+      break;
+    case EngineType::HUB_LABELS:
+      router_ = std::make_unique<graph::HubLabelRouter<double>>(graph_);
+      break;
+    case EngineType::RAPTOR:
+      break;
+  }
+}
+
+void TransportRouter::BuildAllPairsRouter() {
+  switch (matrix_weight_) {
+    case MatrixWeightType::DOUBLE:
+      router_ = MakeAllPairsRouter<double>(graph_, &GetThreadPool(),
+                                           router_cache_file_);
+      break;
+    case MatrixWeightType::FLOAT:
+      router_ = MakeAllPairsRouter<float>(graph_, &GetThreadPool(),
+                                          router_cache_file_);
+      break;
+    case MatrixWeightType::FIXED_POINT:
+      router_ = MakeAllPairsRouter<graph::FixedPoint<uint32_t, 1'000>>(
+          graph_, &GetThreadPool(), router_cache_file_);
+      break;
+  }
+}
+
+parallel::ThreadPool& TransportRouter::GetThreadPool() const {
+  std::call_once(thread_pool_started_, [this] {
+    thread_pool_ = std::make_unique<parallel::ThreadPool>(thread_count_);
+  });
+  return *thread_pool_;
+}
+
+const RaptorRouter& TransportRouter::GetRaptorRouter() const {
+  std::call_once(raptor_router_built_,
+                 [this] { raptor_router_ = MakeRaptorRouter(); });
+  return *raptor_router_;
+}
+
+const graph::DirectedWeightedGraph<double>& TransportRouter::GetReverseGraph()
+    const {
+  std::call_once(reverse_graph_built_,
+                 [this] { reverse_graph_ = MakeReverseGraph(); });
+  return *reverse_graph_;
+}
+
+// Edge ids match those of graph_.
+std::unique_ptr<graph::DirectedWeightedGraph<double>>
+TransportRouter::MakeReverseGraph() const {
+  auto reverse_graph = std::make_unique<graph::DirectedWeightedGraph<double>>(
+      graph_.GetVertexCount());
+  for (graph::EdgeId edge_id = 0; edge_id < graph_.GetEdgeCount(); ++edge_id) {
+    const auto& edge = graph_.GetEdge(edge_id);
+    reverse_graph->AddEdge({edge.to, edge.from, edge.weight});
+  }
+  reverse_graph->Freeze();
+  return reverse_graph;
+}
+
+std::unique_ptr<RaptorRouter> TransportRouter::MakeRaptorRouter() const {
+  return std::make_unique<RaptorRouter>(
+      db_, (double)bus_wait_time_, [this](const Stop* from, const Stop* to) {
+        return GetTravelTime(db_.GetDistance(from->id, to->id));
+      });
+}
+
+void TransportRouter::UpdateDistance(std::string_view from_stop,
+                                     std::string_view to_stop) {
+  if (prune_parallel_edges_ && engine_ != EngineType::RAPTOR) {
+    RebuildRouter();
+    return;
+  }
+  std::vector<graph::EdgeWeightChange<double>> changes;
+  // The distance is also used the other way round when that one is not set,
+  // so buses riding between the stops in either direction are refreshed.
+  const auto rides_between_stops = [&](const Bus* bus) {
+    for (size_t i = 1; i < bus->route.size(); ++i) {
+      std::string_view prev_stop = bus->route[i - 1]->id;
+      std::string_view stop = bus->route[i]->id;
+      if ((prev_stop == from_stop && stop == to_stop) ||
+          (prev_stop == to_stop && stop == from_stop)) {
+        return true;
+      }
+    }
+    return false;
+  };
+  const std::set<std::string_view>* buses = db_.GetBusesByStop(from_stop);
+  if (engine_ != EngineType::RAPTOR && buses) {
+    for (const std::string_view bus_name : *buses) {
+      const Bus* bus = db_.FindBus(bus_name);
+      if (!rides_between_stops(bus)) {
+        continue;
+      }
+      const std::vector<double> travel_times = ComputeBusTravelTimes(bus);
+      const std::vector<graph::EdgeId>& travel_edges =
+          bus_travel_edges_.at(bus->id);
+      for (size_t i = 0; i < travel_edges.size(); ++i) {
+        const double old_weight = graph_.GetEdge(travel_edges[i]).weight;
+        if (old_weight != travel_times[i]) {
+          graph_.SetEdgeWeight(travel_edges[i], travel_times[i]);
+          changes.push_back({travel_edges[i], old_weight});
+        }
+      }
+    }
+  }
+  RepairRouter(changes);
+}
+
+void TransportRouter::AddBus(std::string_view bus_name) {
+  // Its edges were added by the build or an earlier call, and adding them
+  // again would leave two rides for every later distance change to patch.
+  if (engine_ != EngineType::RAPTOR && bus_travel_edges_.count(bus_name)) {
+    return;
+  }
+  if (prune_parallel_edges_ && engine_ != EngineType::RAPTOR) {
+    RebuildRouter();
+    return;
+  }
+  std::vector<graph::EdgeWeightChange<double>> changes;
+  if (engine_ != EngineType::RAPTOR) {
+    graph_.Unfreeze();
+    graph_.AddVertices(CountGraphVertices(graph_model_, db_) -
+                       graph_.GetVertexCount());
+    const graph::EdgeId first_new_edge = graph_.GetEdgeCount();
+    // The bus may serve stops added to the catalogue after the build.
+    for (const auto& stop : *db_.GetAllStops()) {
+      AddStopToGraph(stop.id);
+    }
+    AddBusToGraph(db_.FindBus(bus_name));
+    graph_.Freeze();
+    components_ = graph::GraphComponents(graph_);
+    IndexWaitingEdges();
+    for (graph::EdgeId edge_id = first_new_edge;
+         edge_id < graph_.GetEdgeCount(); ++edge_id) {
+      changes.push_back({edge_id, std::nullopt});
+    }
+  }
+  RepairRouter(changes);
+}
+
+void TransportRouter::RepairRouter(
+    const std::vector<graph::EdgeWeightChange<double>>& changes) {
+  route_cache_.Clear();
+  if (raptor_router_) {
+    // Rebuilding is linear in the total route length.
+    raptor_router_ = MakeRaptorRouter();
   }
-  router_ = std::make_unique<graph::Router<double>>(graph_);
+  if (reverse_graph_) {
+    reverse_graph_ = MakeReverseGraph();
+  }
+  if (engine_ == EngineType::RAPTOR || changes.empty()) {
+    return;
+  }
+  if (engine_ == EngineType::A_STAR) {
+    ComputeMinRoadToGeoRatio();
+  }
+  if (!router_->UpdateEdgeWeights(changes)) {
+    BuildEngine();
+  }
+}
+
+// Every bus edge covers consecutive road segments, each at least
+// min_road_to_geo_ratio_ times longer than the straight line between its
+// stops, so by the triangle inequality the scaled straight-line distance
+// never overestimates the riding time.
+void TransportRouter::ComputeMinRoadToGeoRatio() {
+  std::optional<double> min_ratio;
+  for (const auto& bus : *db_.GetAllBuses()) {
+    for (size_t i = 1; i < bus.route.size(); ++i) {
+      const Stop* from = bus.route[i - 1];
+      const Stop* to = bus.route[i];
+      const double geo_distance =
+          geo::ComputeDistance(from->coords, to->coords);
+      if (geo::IsZero(geo_distance)) {
+        continue;
+      }
+      const double ratio = db_.GetDistance(from->id, to->id) / geo_distance;
+      if (!min_ratio || ratio < *min_ratio) {
+        min_ratio = ratio;
+      }
+    }
+  }
+  min_road_to_geo_ratio_ = min_ratio.value_or(0.0);
+}
+
+double TransportRouter::GetTravelTimeLowerBound(graph::VertexId from,
+                                                graph::VertexId to) const {
+  return GetTravelTime(geo::ComputeDistance(vertex_coordinates_[from],
+                                            vertex_coordinates_[to]) *
+                       min_road_to_geo_ratio_);
+}
+
+size_t RouteCacheKeyHasher::operator()(const RouteCacheKey& key) const {
+  std::hash<const void*> hasher;
+  return (hasher(key.from_stop) * 31 + hasher(key.to_stop)) * 31 +
+         (key.max_transfers ? *key.max_transfers + 1 : 0);
 }
 
 std::optional<RouteInfo> TransportRouter::GetRouteInfo(
-    std::string_view from_stop, std::string_view to_stop) const {
+    std::string_view from_stop, std::string_view to_stop,
+    std::optional<size_t> max_transfers) const {
+  if (route_cache_.GetCapacity() == 0) {
+    return ComputeRouteInfo(from_stop, to_stop, max_transfers);
+  }
+  const RouteCacheKey key =
+      GetRouteCacheKey(from_stop, to_stop, max_transfers);
+  if (auto cached_route = route_cache_.Get(key)) {
+    return MarkAsCached(**cached_route);
+  }
+  auto route = std::make_shared<const std::optional<RouteInfo>>(
+      ComputeRouteInfo(from_stop, to_stop, max_transfers));
+  route_cache_.Put(key, route);
+  return *route;
+}
+
+std::vector<std::optional<RouteInfo>> TransportRouter::GetRouteInfos(
+    std::string_view from_stop, const std::vector<std::string_view>& to_stops,
+    std::optional<size_t> max_transfers) const {
+  std::vector<std::optional<RouteInfo>> result(to_stops.size());
+  const bool is_cache_enabled = route_cache_.GetCapacity() > 0;
+  std::vector<size_t> uncached_positions;
+  for (size_t i = 0; i < to_stops.size(); ++i) {
+    if (!MayReach(from_stop, to_stops[i])) {
+      continue;
+    }
+    if (is_cache_enabled) {
+      if (auto cached_route = route_cache_.Get(
+              GetRouteCacheKey(from_stop, to_stops[i], max_transfers))) {
+        result[i] = MarkAsCached(**cached_route);
+        continue;
+      }
+    }
+    uncached_positions.push_back(i);
+  }
+  if (uncached_positions.empty()) {
+    return result;
+  }
+
+  if (engine_ == EngineType::RAPTOR || max_transfers) {
+    std::vector<const Stop*> targets;
+    for (const size_t i : uncached_positions) {
+      targets.push_back(db_.FindStop(to_stops[i]));
+    }
+    std::vector<std::optional<RaptorRouter::Journey>> journeys =
+        GetRaptorRouter().FindJourneys(db_.FindStop(from_stop), targets,
+                                       max_transfers);
+    for (size_t k = 0; k < uncached_positions.size(); ++k) {
+      if (journeys[k]) {
+        result[uncached_positions[k]] = MakeRouteInfo(*journeys[k]);
+      }
+    }
+  } else if (engine_ == EngineType::ALL_PAIRS ||
+             engine_ == EngineType::HUB_LABELS ||
+             engine_ == EngineType::A_STAR) {
+    // Every route is already precomputed, there is no search to share; an
+    // A* potential leads to one target only, so each gets its own search.
+    for (const size_t i : uncached_positions) {
+      result[i] = ComputeRouteInfo(from_stop, to_stops[i], max_transfers);
+    }
+  } else {
+    std::vector<graph::VertexId> targets;
+    for (const size_t i : uncached_positions) {
+      targets.push_back(stop_name_to_in_vertex_id_.at(to_stops[i]));
+    }
+    std::vector<std::optional<graph::RouterEngine<double>::RouteInfo>> routes =
+        graph::BuildRoutesFrom(graph_,
+                               stop_name_to_in_vertex_id_.at(from_stop),
+                               targets);
+    for (size_t k = 0; k < uncached_positions.size(); ++k) {
+      if (routes[k]) {
+        result[uncached_positions[k]] = MakeRouteInfo(*routes[k]);
+      }
+    }
+  }
+
+  if (is_cache_enabled) {
+    for (const size_t i : uncached_positions) {
+      route_cache_.Put(
+          GetRouteCacheKey(from_stop, to_stops[i], max_transfers),
+          std::make_shared<const std::optional<RouteInfo>>(result[i]));
+    }
+  }
+  return result;
+}
+
+std::vector<RouteInfo> TransportRouter::GetAlternativeRouteInfos(
+    std::string_view from_stop, std::string_view to_stop, size_t max_count,
+    std::optional<size_t> max_transfers) const {
+  std::vector<RouteInfo> result;
+  if (max_count == 0 || !MayReach(from_stop, to_stop)) {
+    return result;
+  }
+  if (engine_ == EngineType::RAPTOR || max_transfers) {
+    if (auto route = GetRouteInfo(from_stop, to_stop, max_transfers)) {
+      result.push_back(std::move(*route));
+    }
+    return result;
+  }
+
+  const graph::VertexId from_vertex = stop_name_to_in_vertex_id_.at(from_stop);
+  const graph::VertexId to_vertex = stop_name_to_in_vertex_id_.at(to_stop);
+  // Exact times to the target, from one search over the reversed graph, are
+  // the tightest potential there is: spur searches then settle little more
+  // than the vertices of routes within the stretch, and none that cannot
+  // reach the target at all.
+  std::vector<double> times_to_target(
+      graph_.GetVertexCount(), std::numeric_limits<double>::infinity());
+  graph::VisitVerticesWithin(GetReverseGraph(), to_vertex,
+                             std::numeric_limits<double>::max(),
+                             [&](graph::VertexId vertex, double time) {
+                               times_to_target[vertex] = time;
+                               return true;
+                             });
+  graph::LooplessRouteEnumerator<double> routes(
+      graph_, from_vertex, to_vertex,
+      [&times_to_target](graph::VertexId vertex, graph::VertexId) {
+        return times_to_target[vertex];
+      });
+  std::optional<graph::RouterEngine<double>::RouteInfo> route = routes.Next();
+  if (!route) {
+    return result;
+  }
+  routes.SetMaxWeight(route->weight * alternatives_stretch_);
+  result.push_back(MakeRouteInfo(*route));
+
+  // Getting off a bus only to board the same bus again is never a useful
+  // alternative, nor is a route with the same items as one already found,
+  // which a bus passing the same stops twice gives as a parallel edge.
+  // Such routes are skipped, but only so many of them, as each one costs a
+  // round of spur searches.
+  const auto is_found = [&result](const RouteInfo& route_info) {
+    return std::any_of(result.begin(), result.end(),
+                       [&route_info](const RouteInfo& found) {
+                         return found.items == route_info.items;
+                       });
+  };
+  size_t skipped_count = 0;
+  while (result.size() < max_count &&
+         skipped_count < max_count * MAX_SKIPPED_PER_ALTERNATIVE) {
+    route = routes.Next();
+    if (!route) {
+      break;
+    }
+    RouteInfo route_info = MakeRouteInfo(*route);
+    if (ReboardsSameBus(route_info) || is_found(route_info)) {
+      ++skipped_count;
+      continue;
+    }
+    result.push_back(std::move(route_info));
+  }
+  return result;
+}
+
+ParetoRouteInfos TransportRouter::GetParetoRouteInfos(
+    std::string_view from_stop, std::string_view to_stop,
+    std::optional<size_t> max_transfers) const {
+  ParetoRouteInfos result;
+  if (!MayReach(from_stop, to_stop)) {
+    return result;
+  }
+  if (engine_ == EngineType::RAPTOR) {
+    for (const RaptorRouter::Journey& journey :
+         GetRaptorRouter().FindParetoJourneys(
+             db_.FindStop(from_stop), db_.FindStop(to_stop), max_transfers)) {
+      result.routes.push_back(MakeRouteInfo(journey));
+    }
+    result.label_count = RaptorRouter::GetLastLabelCount();
+    return result;
+  }
+
+  const size_t max_bus_count =
+      max_transfers ? *max_transfers + 1 : std::numeric_limits<size_t>::max();
+  for (const auto& route :
+       graph::ParetoRouter<double>(graph_, is_waiting_edge_)
+           .BuildRoutes(stop_name_to_in_vertex_id_.at(from_stop),
+                        stop_name_to_in_vertex_id_.at(to_stop),
+                        max_bus_count)) {
+    result.routes.push_back(
+        MakeRouteInfo(graph::RouterEngine<double>::RouteInfo{
+            route.weight, route.edges}));
+  }
+  result.label_count = graph::ParetoRouter<double>::GetLastLabelCount();
+  return result;
+}
+
+caching::CacheStats TransportRouter::GetRouteCacheStats() const {
+  return route_cache_.GetStats();
+}
+
+std::optional<size_t> TransportRouter::GetPrunedEdgeCount() const {
+  if (!prune_parallel_edges_) {
+    return std::nullopt;
+  }
+  return pruned_edge_count_;
+}
+
+std::optional<graph::HubLabelStats> TransportRouter::GetHubLabelStats() const {
+  const auto* hub_label_router =
+      dynamic_cast<const graph::HubLabelRouter<double>*>(router_.get());
+  if (!hub_label_router) {
+    return std::nullopt;
+  }
+  return hub_label_router->GetStats();
+}
+
+std::optional<size_t> TransportRouter::GetAllPairsMatrixBytes() const {
+  if (engine_ != EngineType::ALL_PAIRS) {
+    return std::nullopt;
+  }
+  switch (matrix_weight_) {
+    case MatrixWeightType::DOUBLE:
+      return GetMatrixBytes<double>(router_.get());
+    case MatrixWeightType::FLOAT:
+      return GetMatrixBytes<float>(router_.get());
+    case MatrixWeightType::FIXED_POINT:
+      return GetMatrixBytes<graph::FixedPoint<uint32_t, 1'000>>(
+          router_.get());
+  }
+  return std::nullopt;
+}
+
+RouteCacheKey TransportRouter::GetRouteCacheKey(
+    std::string_view from_stop, std::string_view to_stop,
+    std::optional<size_t> max_transfers) const {
+  return {db_.FindStop(from_stop), db_.FindStop(to_stop), max_transfers};
+}
+
+std::optional<RouteInfo> TransportRouter::ComputeRouteInfo(
+    std::string_view from_stop, std::string_view to_stop,
+    std::optional<size_t> max_transfers) const {
+  if (!MayReach(from_stop, to_stop)) {
+    return std::nullopt;
+  }
+  if (engine_ == EngineType::RAPTOR || max_transfers) {
+    std::optional<RaptorRouter::Journey> journey =
+        GetRaptorRouter().FindJourney(db_.FindStop(from_stop),
+                                      db_.FindStop(to_stop), max_transfers);
+    if (!journey) {
+      return std::nullopt;
+    }
+    return MakeRouteInfo(*journey);
+  }
   graph::VertexId from_in_id = stop_name_to_in_vertex_id_.at(from_stop);
   graph::VertexId to_in_id = stop_name_to_in_vertex_id_.at(to_stop);
 
-  std::optional<graph::Router<double>::RouteInfo> route =
+  std::optional<graph::RouterEngine<double>::RouteInfo> route =
       router_->BuildRoute(from_in_id, to_in_id);
   if (route) {
-    RouteInfo result;
-    result.total_time = (*route).weight;
-    for (const graph::EdgeId edge_id : (*route).edges) {
-      std::unordered_map<std::string, std::string> item;
-      std::string type = (waiting_edges_.count(edge_id) ? "Wait" : "Bus");
-      item["type"] = type;
-      if (type == "Wait") {
-        graph::VertexId stop_id = graph_.GetEdge(edge_id).from;
-        std::string stop_name(vertex_id_to_stop_name_.at(stop_id));
-        item["stop_name"] = stop_name;
-      } else if (type == "Bus") {
-        item["bus"] = std::string(edge_to_bus_name_.at(edge_id));
-        item["span_count"] = std::to_string(edge_to_span_count_.at(edge_id));
-      }
-      item["time"] = std::to_string(graph_.GetEdge(edge_id).weight);
-      result.items.emplace_back(std::move(item));
-    }
-    return result;
+    return MakeRouteInfo(*route);
   }
   return std::nullopt;
 }
 
+RouteInfo TransportRouter::MakeRouteInfo(
+    const graph::RouterEngine<double>::RouteInfo& route) const {
+  RouteInfo result;
+  result.total_time = route.weight;
+  if (route.settled_count > 0) {
+    result.settled_count = route.settled_count;
+  }
+
+  // Consecutive bus edges are ride edges of one trip in the route-expanded
+  // model and are reported as a single Bus item, as in the stop-pairs one.
+  std::string_view bus_name;
+  size_t span_count = 0;
+  double bus_time = 0.0;
+  auto flush_bus_item = [&] {
+    if (span_count == 0) {
+      return;
+    }
+    result.items.emplace_back(BusItem{bus_name, span_count, bus_time});
+    span_count = 0;
+  };
+
+  for (const graph::EdgeId edge_id : route.edges) {
+    const auto& edge = graph_.GetEdge(edge_id);
+    const EdgePayload& payload = graph_.GetPayload(edge_id);
+    switch (payload.kind) {
+      case EdgeKind::ALIGHT:
+        flush_bus_item();
+        break;
+      case EdgeKind::WAIT:
+        flush_bus_item();
+        result.items.emplace_back(
+            WaitItem{vertex_stop_names_[edge.from], edge.weight});
+        break;
+      case EdgeKind::RIDE:
+        if (span_count == 0) {
+          bus_name = payload.bus->id;
+          bus_time = edge.weight;
+        } else {
+          bus_time += edge.weight;
+        }
+        span_count += payload.span_count;
+        break;
+    }
+  }
+  flush_bus_item();
+  return result;
+}
+
+RouteInfo TransportRouter::MakeRouteInfo(
+    const RaptorRouter::Journey& journey) const {
+  RouteInfo result;
+  result.total_time = journey.total_time;
+  result.items.reserve(journey.legs.size() * 2);
+  for (const RaptorRouter::Leg& leg : journey.legs) {
+    result.items.emplace_back(
+        WaitItem{leg.board_stop->id, (double)bus_wait_time_});
+    result.items.emplace_back(
+        BusItem{leg.bus->id, leg.span_count, leg.ride_time});
+  }
+  return result;
+}
+
+std::vector<ReachableStop> TransportRouter::GetReachableStops(
+    std::string_view from_stop, double max_time) const {
+  std::vector<ReachableStop> result;
+  if (engine_ == EngineType::RAPTOR) {
+    for (const auto& [stop, time] :
+         GetRaptorRouter().FindReachableStops(db_.FindStop(from_stop),
+                                              max_time)) {
+      result.push_back({stop->id, time});
+    }
+  } else {
+    graph::VisitVerticesWithin(
+        graph_, stop_name_to_in_vertex_id_.at(from_stop), max_time,
+        [&](graph::VertexId vertex, double time) {
+          // Out and ride vertices are skipped: a stop is reached once its
+          // in vertex is.
+          const std::string_view stop_name = vertex_stop_names_[vertex];
+          if (!stop_name.empty() &&
+              stop_name_to_in_vertex_id_.at(stop_name) == vertex) {
+            result.push_back({stop_name, time});
+          }
+          return true;
+        });
+  }
+  std::sort(result.begin(), result.end(),
+            [](const ReachableStop& lhs, const ReachableStop& rhs) {
+              return std::tie(lhs.time, lhs.stop_name) <
+                     std::tie(rhs.time, rhs.stop_name);
+            });
+  return result;
+}
+
+std::vector<std::vector<std::optional<double>>>
+TransportRouter::GetTravelTimeMatrix(
+    const std::vector<std::string_view>& from_stops,
+    const std::vector<std::string_view>& to_stops) const {
+  std::vector<std::vector<std::optional<double>>> matrix(
+      from_stops.size(), std::vector<std::optional<double>>(to_stops.size()));
+
+  if (engine_ == EngineType::RAPTOR) {
+    GetThreadPool().ParallelFor(from_stops.size(), [&](size_t row) {
+      std::unordered_map<std::string_view, double> times;
+      for (const auto& [stop, time] : GetRaptorRouter().FindReachableStops(
+               db_.FindStop(from_stops[row]),
+               std::numeric_limits<double>::infinity())) {
+        times[stop->id] = time;
+      }
+      for (size_t column = 0; column < to_stops.size(); ++column) {
+        if (auto it = times.find(to_stops[column]); it != times.end()) {
+          matrix[row][column] = it->second;
+        }
+      }
+    });
+    return matrix;
+  }
+
+  if (engine_ == EngineType::ALL_PAIRS || engine_ == EngineType::HUB_LABELS) {
+    GetThreadPool().ParallelFor(from_stops.size(), [&](size_t row) {
+      const graph::VertexId from = stop_name_to_in_vertex_id_.at(from_stops[row]);
+      for (size_t column = 0; column < to_stops.size(); ++column) {
+        matrix[row][column] = router_->GetRouteWeight(
+            from, stop_name_to_in_vertex_id_.at(to_stops[column]));
+      }
+    });
+    return matrix;
+  }
+
+  // On-demand engines run one one-to-all search per source that stops once
+  // every target is settled.
+  std::unordered_map<graph::VertexId, std::vector<size_t>> target_columns;
+  for (size_t column = 0; column < to_stops.size(); ++column) {
+    target_columns[stop_name_to_in_vertex_id_.at(to_stops[column])].push_back(
+        column);
+  }
+  GetThreadPool().ParallelFor(from_stops.size(), [&](size_t row) {
+    const graph::VertexId from = stop_name_to_in_vertex_id_.at(from_stops[row]);
+    // Targets the components rule out are not waited for.
+    size_t targets_left = 0;
+    for (const auto& [target, columns] : target_columns) {
+      targets_left += components_.MayReach(from, target) ? 1 : 0;
+    }
+    if (targets_left == 0) {
+      return;
+    }
+    graph::VisitVerticesWithin(
+        graph_, from, std::numeric_limits<double>::infinity(),
+        [&](graph::VertexId vertex, double time) {
+          auto it = target_columns.find(vertex);
+          if (it == target_columns.end()) {
+            return true;
+          }
+          for (const size_t column : it->second) {
+            matrix[row][column] = time;
+          }
+          return --targets_left > 0;
+        });
+  });
+  return matrix;
+}
+
 double TransportRouter::GetTravelTime(double distance) const {
   return (distance / METERS_PER_KILOMETER) / (bus_velocity_ / MINUTES_PER_HOUR);
 }
@@ -1,46 +1,289 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
+#include "components.h"
+#include "geo.h"
 #include "graph.h"
+#include "hub_labels.h"
 #include "json.h"
+#include "lru_cache.h"
+#include "raptor_router.h"
 #include "router.h"
+#include "thread_pool.h"
 #include "transport_catalogue.h"
 
 namespace router {
+enum class EngineType {
+  ALL_PAIRS,
+  DIJKSTRA,
+  A_STAR,
+  CONTRACTION_HIERARCHY,
+  RAPTOR,
+  // Pruned landmark labeling: near all-pairs query times from labels far
+  // smaller than the all-pairs matrices.
+  HUB_LABELS,
+};
+
+// How the all-pairs engine stores route weights: FLOAT and FIXED_POINT
+// (thousandths of a minute) halve the weight matrix at some precision cost.
+enum class MatrixWeightType {
+  DOUBLE,
+  FLOAT,
+  FIXED_POINT,
+};
+
+// STOP_PAIRS links every stop of a bus to each later stop with its own edge,
+// so a k-stop bus adds O(k^2) edges. ROUTE_EXPANDED gives every (bus,
+// position) a ride vertex chained along the route and connects it to its
+// stop with a boarding edge carrying the wait and a free alighting edge:
+// O(k) edges per bus at the cost of one extra vertex per route position.
+enum class GraphModel {
+  STOP_PAIRS,
+  ROUTE_EXPANDED,
+};
+
+// Order in which stops get their graph vertices: as the catalogue lists
+// them, or along a Hilbert curve over their coordinates so that stops near
+// each other, which share most edges, also sit near each other in memory.
+enum class VertexOrder {
+  CATALOGUE,
+  HILBERT,
+};
+
+struct RoutingSettings {
+  double bus_velocity = 0.0;
+  int bus_wait_time = 0;
+  EngineType engine = EngineType::ALL_PAIRS;
+  MatrixWeightType matrix_weight = MatrixWeightType::DOUBLE;
+  GraphModel graph_model = GraphModel::STOP_PAIRS;
+  VertexOrder vertex_order = VertexOrder::CATALOGUE;
+  // Leaves out bus edges that a cheaper edge between the same two vertices
+  // makes useless, which are most edges where many buses share a corridor.
+  bool prune_parallel_edges = false;
+  size_t thread_count = parallel::ThreadPool::GetDefaultThreadCount();
+  // Finished Route results kept for repeated stop pairs; 0 disables it.
+  size_t route_cache_size = 0;
+  // Alternative routes may take at most this many times the best route's
+  // time.
+  double alternatives_stretch = 1.5;
+  // Where the all-pairs matrices are saved after a build and mapped from on
+  // later starts, as long as the graph is the same; empty disables it.
+  std::string router_cache_file;
+};
+
+// Names point into the catalogue.
+struct WaitItem {
+  std::string_view stop_name;
+  double time;
+
+  bool operator==(const WaitItem& other) const {
+    return stop_name == other.stop_name && time == other.time;
+  }
+};
+
+struct BusItem {
+  std::string_view bus_name;
+  size_t span_count;
+  double time;
+
+  bool operator==(const BusItem& other) const {
+    return bus_name == other.bus_name && span_count == other.span_count &&
+           time == other.time;
+  }
+};
+
+using RouteItem = std::variant<WaitItem, BusItem>;
+
 struct RouteInfo {
   double total_time;
-  std::vector<std::unordered_map<std::string, std::string>> items;
+  std::vector<RouteItem> items;
+  // Vertices settled by the graph search that found the route, 0 for a
+  // cached route; empty when the engine answered from precomputed data.
+  std::optional<size_t> settled_count;
+};
+
+struct RouteCacheKey {
+  catalogue::TransportCatalogue::StopPtr from_stop;
+  catalogue::TransportCatalogue::StopPtr to_stop;
+  std::optional<size_t> max_transfers;
+
+  bool operator==(const RouteCacheKey& other) const {
+    return from_stop == other.from_stop && to_stop == other.to_stop &&
+           max_transfers == other.max_transfers;
+  }
+};
+
+struct RouteCacheKeyHasher {
+  size_t operator()(const RouteCacheKey& key) const;
+};
+
+// Routes that are each faster than the next or take fewer buses than the
+// previous one, and the labels the search created to find them.
+struct ParetoRouteInfos {
+  std::vector<RouteInfo> routes;
+  size_t label_count = 0;
+};
+
+struct ReachableStop {
+  std::string_view stop_name;
+  double time;
 };
 
 class TransportRouter {
  public:
-  TransportRouter(double bus_velocity, int bus_wait_time,
+  TransportRouter(const RoutingSettings& settings,
                   const catalogue::TransportCatalogue& db);
-  std::optional<RouteInfo> GetRouteInfo(std::string_view from_stop,
-                                        std::string_view to_stop) const;
+  // A transfer limit is answered by the round-based router whatever the
+  // engine; it is built on first use if the engine is a graph one.
+  std::optional<RouteInfo> GetRouteInfo(
+      std::string_view from_stop, std::string_view to_stop,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+  // Routes from one stop to many. On-demand engines answer all of them from
+  // one search instead of one search per target.
+  std::vector<std::optional<RouteInfo>> GetRouteInfos(
+      std::string_view from_stop, const std::vector<std::string_view>& to_stops,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+  // Up to max_count loopless routes, best first, none slower than the
+  // alternatives stretch allows. They are searched on the graph for every
+  // query whatever the engine; with the round-based router or a transfer
+  // limit only the best route is given.
+  std::vector<RouteInfo> GetAlternativeRouteInfos(
+      std::string_view from_stop, std::string_view to_stop, size_t max_count,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+  // The Pareto set of routes minimizing both the time and the number of
+  // buses taken, fastest first. The round-based engine reads it off its
+  // rounds, the others run a bicriteria label search on the graph.
+  ParetoRouteInfos GetParetoRouteInfos(
+      std::string_view from_stop, std::string_view to_stop,
+      std::optional<size_t> max_transfers = std::nullopt) const;
+  // Stops reachable from from_stop within max_time, sorted by time.
+  std::vector<ReachableStop> GetReachableStops(std::string_view from_stop,
+                                               double max_time) const;
+  // Best travel time from every from_stop (rows) to every to_stop (columns),
+  // nullopt where there is no route. Rows are computed in parallel.
+  std::vector<std::vector<std::optional<double>>> GetTravelTimeMatrix(
+      const std::vector<std::string_view>& from_stops,
+      const std::vector<std::string_view>& to_stops) const;
+  caching::CacheStats GetRouteCacheStats() const;
+  // Label footprint of the hub-label engine; nullopt for other engines.
+  std::optional<graph::HubLabelStats> GetHubLabelStats() const;
+  // Footprint of the all-pairs matrices; nullopt for other engines.
+  std::optional<size_t> GetAllPairsMatrixBytes() const;
+  // Bus edges left out of the graph by parallel-edge pruning; nullopt when
+  // pruning is off.
+  std::optional<size_t> GetPrunedEdgeCount() const;
+
+  // Incremental updates after the catalogue changed: the graph's edge
+  // weights are patched in place and the engine repairs what it
+  // precomputed, or is rebuilt if it cannot. With parallel-edge pruning
+  // the whole graph is built again instead. A bus the router already has
+  // is left as it is. Not safe to run concurrently with queries.
+  void UpdateDistance(std::string_view from_stop, std::string_view to_stop);
+  void AddBus(std::string_view bus_name);
 
  private:
+  // What an edge of the graph stands for. Only ride edges have a bus and a
+  // span count.
+  enum class EdgeKind : uint8_t {
+    WAIT,
+    RIDE,
+    ALIGHT,
+  };
+
+  struct EdgePayload {
+    EdgeKind kind;
+    uint32_t span_count;
+    catalogue::TransportCatalogue::BusPtr bus;
+  };
+
+  // Edges of one bus in the order they get their ids.
+  struct BusEdges {
+    std::vector<graph::Edge<double>> edges;
+    std::vector<EdgePayload> payloads;
+  };
+
   const catalogue::TransportCatalogue& db_;
-  graph::DirectedWeightedGraph<double> graph_;
-  std::unique_ptr<graph::Router<double>> router_;
+  size_t thread_count_;
+  // Started on first use, so engines that answer every query with a search
+  // on the calling thread start no threads unless a Matrix request comes.
+  mutable std::once_flag thread_pool_started_;
+  mutable std::unique_ptr<parallel::ThreadPool> thread_pool_;
+  graph::DirectedWeightedGraph<double, EdgePayload> graph_;
+  graph::GraphComponents components_;
+  std::unique_ptr<graph::RouterEngine<double>> router_;
+  mutable std::once_flag raptor_router_built_;
+  mutable std::unique_ptr<RaptorRouter> raptor_router_;
+  mutable std::once_flag reverse_graph_built_;
+  mutable std::unique_ptr<graph::DirectedWeightedGraph<double>> reverse_graph_;
+  mutable caching::LruCache<RouteCacheKey,
+                            std::shared_ptr<const std::optional<RouteInfo>>,
+                            RouteCacheKeyHasher>
+      route_cache_;
 
   double bus_velocity_;
   int bus_wait_time_;
+  EngineType engine_;
+  MatrixWeightType matrix_weight_;
+  GraphModel graph_model_;
+  VertexOrder vertex_order_;
+  bool prune_parallel_edges_;
+  size_t pruned_edge_count_ = 0;
+  double alternatives_stretch_;
+  std::string router_cache_file_;
   graph::VertexId current_vertex_id_ = 0;
   std::unordered_map<std::string_view, graph::VertexId>
       stop_name_to_in_vertex_id_;
-  std::unordered_map<graph::VertexId, std::string_view> vertex_id_to_stop_name_;
-  std::unordered_map<graph::EdgeId, std::string_view> edge_to_bus_name_;
-  std::unordered_map<graph::EdgeId, size_t> edge_to_span_count_;
-  std::unordered_set<graph::EdgeId> waiting_edges_;
+  // Indexed by vertex; ride vertices have no stop name.
+  std::vector<std::string_view> vertex_stop_names_;
+  std::vector<geo::Coordinates> vertex_coordinates_;
+  double min_road_to_geo_ratio_ = 0.0;
+  std::vector<bool> is_waiting_edge_;
+  std::unordered_map<std::string_view, std::vector<graph::EdgeId>>
+      bus_travel_edges_;
 
   double GetTravelTime(double distance) const;
   void AddStopToGraph(std::string_view stop_name);
   void AddBusToGraph(catalogue::TransportCatalogue::BusPtr bus);
+  BusEdges MakeBusEdges(catalogue::TransportCatalogue::BusPtr bus,
+                        graph::VertexId first_ride_vertex) const;
+  void AddBusEdges(catalogue::TransportCatalogue::BusPtr bus,
+                   const BusEdges& bus_edges);
+  size_t PruneParallelEdges(std::vector<BusEdges>& bus_edges) const;
+  std::vector<double> ComputeBusTravelTimes(
+      catalogue::TransportCatalogue::BusPtr bus) const;
+  void ComputeMinRoadToGeoRatio();
+  double GetTravelTimeLowerBound(graph::VertexId from,
+                                 graph::VertexId to) const;
   void BuildRouter();
+  void RebuildRouter();
+  bool MayReach(std::string_view from_stop, std::string_view to_stop) const;
+  void IndexWaitingEdges();
+  void BuildEngine();
+  void BuildAllPairsRouter();
+  void RepairRouter(
+      const std::vector<graph::EdgeWeightChange<double>>& changes);
+  parallel::ThreadPool& GetThreadPool() const;
+  const RaptorRouter& GetRaptorRouter() const;
+  std::unique_ptr<RaptorRouter> MakeRaptorRouter() const;
+  const graph::DirectedWeightedGraph<double>& GetReverseGraph() const;
+  std::unique_ptr<graph::DirectedWeightedGraph<double>> MakeReverseGraph()
+      const;
+  std::optional<RouteInfo> ComputeRouteInfo(
+      std::string_view from_stop, std::string_view to_stop,
+      std::optional<size_t> max_transfers) const;
+  RouteCacheKey GetRouteCacheKey(std::string_view from_stop,
+                                 std::string_view to_stop,
+                                 std::optional<size_t> max_transfers) const;
+  RouteInfo MakeRouteInfo(
+      const graph::RouterEngine<double>::RouteInfo& route) const;
+  RouteInfo MakeRouteInfo(const RaptorRouter::Journey& journey) const;
 };
 }  // namespace router
\ No newline at end of file